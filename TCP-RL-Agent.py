@@ -2,7 +2,9 @@
 # -*- coding: utf-8 -*-
 import math
 import sys
+import struct
 import argparse
+import subprocess
 
 import numpy as np
 import matplotlib as mpl
@@ -11,7 +13,7 @@ import matplotlib.pyplot as plt
 import tensorflow as tf
 
 from ns3gym import ns3env
-from tcp_base import TcpTimeBased, TcpEventBased
+from tcp_base import TcpTimeBased, TcpEventBased, ShmEnv
 import os
 os.environ["CUDA_VISIBLE_DEVICES"] = "-1"
 
@@ -35,6 +37,18 @@ parser.add_argument('--steps',
 					type=int,
 					default=100,
 					help='Adım sayısı, Varsayılan: 100')
+parser.add_argument('--shm_file',
+					type=str,
+					default='',
+					help='ZMQ yerine paylaşılan bellek dosyası, ns-3 aynı --shm_file ile ayrıca başlatılmalı, Varsayılan: ""')
+parser.add_argument('--reuse_sim',
+					type=int,
+					default=0,
+					help='Tüm tekrarları tek ns-3 sürecinde koştur (sim --episodes), reset() süreci yeniden başlatmaz 0/1, Varsayılan: 0')
+parser.add_argument('--sim_cmd',
+					type=str,
+					default='./ns3 run "sim {args}"',
+					help='--reuse_sim ile sim.cc programını çalıştıran komut, {args} yerine argümanlar gelir')
 
 args = parser.parse_args()
 
@@ -51,8 +65,21 @@ simArgs = {"--duration": simTime,}
 dashes = "-"*18
 input("[{}Başlamak için enter'a basınız{}]".format(dashes, dashes))
 
+# Simülasyonu bir kez başlat, her reset() aynı süreçte kurulan yeni bölüme bağlanır
+simProc = None
+if args.reuse_sim and startSim:
+	simCmdArgs = "--duration=%g --simSeed=%d --openGymPort=%d --episodes=%d" % (simTime, seed, port, iterationNum)
+	if args.shm_file:
+		simCmdArgs += " --transport_prot=TcpRlTimeBased --shm_file=" + args.shm_file
+	simProc = subprocess.Popen(args.sim_cmd.format(args=simCmdArgs), shell=True)
+	startSim = False
+
 # Ortamı oluştur
-env = ns3env.Ns3Env(port=port, startSim=startSim, simSeed=seed, simArgs=simArgs)
+if args.shm_file:
+	# ns-3 dosyayı oluşturana kadar bekler
+	env = ShmEnv(args.shm_file)
+else:
+	env = ns3env.Ns3Env(port=port, startSim=startSim, simSeed=seed, simArgs=simArgs)
 
 ob_space = env.observation_space
 ac_space = env.action_space
@@ -100,6 +127,26 @@ def modeler(input_size, output_size):
     
     return model
 
+# Eğitilmiş modeli TcpRlPolicy için ikili dosyaya aktar (bkz. tcp-rl-policy.h)
+def export_policy(model, file_name, cwnd_deltas, recency):
+    """
+    Dense katmanları "TRLP" formatında yazar, recency pencere sınırındaki verim kontrolü için.
+    """
+    activations = {'linear': 0, 'relu': 1, 'tanh': 2, 'softmax': 3}
+    layers = [layer for layer in model.layers if isinstance(layer, tf.keras.layers.Dense)]
+    with open(file_name, 'wb') as f:
+        f.write(b'TRLP')
+        f.write(struct.pack('<III', 2, model.input_shape[-1], len(layers)))
+        for layer in layers:
+            weights, bias = layer.get_weights()
+            f.write(struct.pack('<II', weights.shape[1], activations[layer.activation.__name__]))
+            # Keras (giriş, çıkış) tutar, C++ tarafı satır başına bir çıkış bekler
+            f.write(np.ascontiguousarray(weights.T, dtype='<f4').tobytes())
+            f.write(np.asarray(bias, dtype='<f4').tobytes())
+        f.write(struct.pack('<I', len(cwnd_deltas)))
+        f.write(np.asarray(cwnd_deltas, dtype='<i4').tobytes())
+        f.write(struct.pack('<I', recency))
+
 # Durum ve aksiyon boyutlarını belirle
 state_size = ob_space.shape[0] - 4 # Ortamın 4 özelliğini görmezden gel
 
@@ -221,10 +268,22 @@ for iteration in range(iterationNum):
 			rtt_history.append(rtt)
 			cWnd_history.append(cWnd)
 			tp_history.append(throughput)
+
+		# Sonraki bölüm bu bölüm bitince başlar, kalan adımlar son aksiyonla
+		if args.reuse_sim:
+			while not done:
+				_, _, done, _ = env.step(actions)
 	finally:
 		if iteration+1 == iterationNum:
 			break
 
+if simProc is not None:
+	env.close()
+	simProc.wait()
+
+# Ajansız değerlendirme için modeli dışa aktar (--transport_prot=TcpRlPolicy)
+export_policy(model, 'policy.bin', [action_mapping[i] for i in range(action_size)], recency)
+
 # RTT ve TP geçmişini dosyaya yazdır
 with open('rtt_tp_history.txt', 'w') as file:
     file.write("Adım\tRTT (μs)\tThroughput (bits)\n")
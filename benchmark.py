@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""sim.cc için uçtan uca benchmark matrisi.
+
+Her protokol, darboğaz bant genişliği, gecikme, kayıp oranı ve akış sayısı
+için birkaç tohumla koşar. RL protokolleri ajan süreci yerine yerel
+TcpRlNewRenoAgent ile çalışır. Her koşu --summary_file ile bir JSON satırı
+yazar, burada ortalama ve %95 güven aralığı hesaplanır.
+
+Örnek (ns-3 kök dizininden):
+  python3 contrib/opengym/examples/TCP-RL/benchmark.py --output base.json
+  python3 contrib/opengym/examples/TCP-RL/benchmark.py --compare base.json
+"""
+import argparse
+import itertools
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+MATRIX = {
+	"transport_prot": ["TcpNewReno", "TcpRl", "TcpRlTimeBased"],
+	"bottleneck_bandwidth": ["2Mbps", "10Mbps"],
+	"bottleneck_delay": ["0.01ms", "20ms"],
+	"error_p": [0.0, 0.01],
+	"nLeaf": [1, 4],
+}
+QUICK_MATRIX = {
+	"transport_prot": ["TcpNewReno", "TcpRl", "TcpRlTimeBased"],
+	"bottleneck_bandwidth": ["2Mbps"],
+	"bottleneck_delay": ["0.01ms"],
+	"error_p": [0.0],
+	"nLeaf": [2],
+}
+# 1-10 Gbps darboğaz, 50 ms RTT, BDP kadar kuyruk ve BDP'den büyük TCP tamponu
+HIGH_BDP_MATRIX = {
+	"transport_prot": ["TcpNewReno", "TcpRl", "TcpRlTimeBased"],
+	"bottleneck_bandwidth": ["1Gbps", "10Gbps"],
+	"bottleneck_delay": ["5ms"],
+	"error_p": [0.0],
+	"nLeaf": [1, 4],
+}
+HIGH_BDP_ARGS = {
+	"access_bandwidth": "40Gbps",
+	"access_delay": "10ms",
+	"mtu": 1500,
+	"tcp_buffer": 1 << 27,
+}
+
+# metrik: büyük değer daha iyi mi
+METRICS = {
+	"goodput_bps": True,
+	"p95_delay_s": False,
+	"loss_rate": False,
+	"fairness": True,
+	"wall_s": False,
+	"events_per_s": True,
+}
+
+# %95 iki taraflı Student t değerleri, serbestlik derecesine göre
+T_975 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+
+
+def confidence_interval(values):
+	"""ortalama ve %95 güven aralığının yarı genişliği"""
+	n = len(values)
+	mean = sum(values) / n
+	if n < 2:
+		return mean, 0.0
+	sd = math.sqrt(sum((v - mean) ** 2 for v in values) / (n - 1))
+	t = T_975[n - 2] if n - 1 <= len(T_975) else 1.96
+	return mean, t * sd / math.sqrt(n)
+
+
+def run_point(sim_cmd, point, seed, duration, summary_file, extra_args):
+	args = ["--%s=%s" % (name, value) for name, value in list(point.items()) + list(extra_args.items())]
+	args += ["--run=%d" % seed, "--duration=%g" % duration, "--summary_file=%s" % summary_file]
+	if point["transport_prot"] != "TcpNewReno":
+		args.append("--local_agent=TcpRlNewRenoAgent")
+	cmd = sim_cmd.format(args=" ".join(args))
+	subprocess.run(cmd, shell=True, check=True, stdout=subprocess.DEVNULL)
+
+
+def point_key(row):
+	return tuple(row[name] for name in MATRIX)
+
+
+def summarize(runs):
+	groups = {}
+	for row in runs:
+		groups.setdefault(point_key(row), []).append(row)
+	summary = []
+	for key, rows in sorted(groups.items(), key=lambda item: str(item[0])):
+		entry = dict(zip(MATRIX, key))
+		entry["seeds"] = len(rows)
+		for metric in METRICS:
+			mean, half_width = confidence_interval([row[metric] for row in rows])
+			entry[metric] = {"mean": mean, "ci95": half_width}
+		summary.append(entry)
+	return summary
+
+
+def print_summary(summary):
+	names = list(MATRIX)
+	print("\t".join(names + list(METRICS)))
+	for entry in summary:
+		cells = [str(entry[name]) for name in names]
+		cells += ["%.4g ± %.2g" % (entry[m]["mean"], entry[m]["ci95"]) for m in METRICS]
+		print("\t".join(cells))
+
+
+def compare(summary, baseline, tolerance):
+	"""güven aralıkları ve tolerans dışında kötüleşen metrikler"""
+	base = {point_key(entry): entry for entry in baseline["summary"]}
+	regressions = []
+	for entry in summary:
+		old = base.get(point_key(entry))
+		if old is None:
+			continue
+		for metric, higher_is_better in METRICS.items():
+			new_mean, new_ci = entry[metric]["mean"], entry[metric]["ci95"]
+			old_mean, old_ci = old[metric]["mean"], old[metric]["ci95"]
+			change = new_mean - old_mean if higher_is_better else old_mean - new_mean
+			if -change > max(new_ci + old_ci, tolerance * abs(old_mean)):
+				regressions.append("%s %s: %.4g -> %.4g" % (point_key(entry), metric, old_mean, new_mean))
+	return regressions
+
+
+def main():
+	parser = argparse.ArgumentParser(description='TcpNewReno / TcpRl / TcpRlTimeBased benchmark matrisi')
+	parser.add_argument('--sim_cmd',
+						type=str,
+						default='./ns3 run "sim {args}"',
+						help='sim.cc programını çalıştıran komut, {args} yerine argümanlar gelir, Varsayılan: ./ns3 run "sim {args}"')
+	parser.add_argument('--seeds',
+						type=int,
+						default=5,
+						help='Her nokta için tohum sayısı, Varsayılan: 5')
+	parser.add_argument('--duration',
+						type=float,
+						default=10.0,
+						help='Simülasyon süresi saniye cinsinden, Varsayılan: 10')
+	parser.add_argument('--quick',
+						action='store_true',
+						help='Küçük matris, hızlı kontrol için')
+	parser.add_argument('--high_bdp',
+						action='store_true',
+						help='1 ve 10 Gbps darboğazlı büyük BDP matrisi, kısa --duration önerilir')
+	parser.add_argument('--output',
+						type=str,
+						default='benchmark_results.json',
+						help='Sonuç dosyası, Varsayılan: benchmark_results.json')
+	parser.add_argument('--compare',
+						type=str,
+						default='',
+						help='Bu sonuç dosyasına göre gerileme varsa 1 ile çıkar')
+	parser.add_argument('--tolerance',
+						type=float,
+						default=0.05,
+						help='Güven aralığı dışında da kabul edilen göreli değişim, Varsayılan: 0.05')
+	args = parser.parse_args()
+
+	matrix = QUICK_MATRIX if args.quick else MATRIX
+	extra_args = {}
+	if args.high_bdp:
+		matrix = HIGH_BDP_MATRIX
+		extra_args = HIGH_BDP_ARGS
+	points = [dict(zip(matrix, values)) for values in itertools.product(*matrix.values())]
+
+	fd, summary_file = tempfile.mkstemp(suffix=".jsonl")
+	os.close(fd)
+	try:
+		for i, point in enumerate(points):
+			print("[%d/%d] %s" % (i + 1, len(points), point), file=sys.stderr)
+			for seed in range(args.seeds):
+				run_point(args.sim_cmd, point, seed, args.duration, summary_file, extra_args)
+		with open(summary_file) as file:
+			runs = [json.loads(line) for line in file if line.strip()]
+	finally:
+		os.remove(summary_file)
+
+	summary = summarize(runs)
+	print_summary(summary)
+	with open(args.output, "w") as file:
+		json.dump({"duration": args.duration, "runs": runs, "summary": summary}, file, indent=1)
+
+	if args.compare:
+		with open(args.compare) as file:
+			baseline = json.load(file)
+		regressions = compare(summary, baseline, args.tolerance)
+		for regression in regressions:
+			print("REGRESSION " + regression)
+		if regressions:
+			sys.exit(1)
+
+
+if __name__ == "__main__":
+	main()
@@ -1,29 +1,41 @@
+import os
+import struct
+
+import numpy as np
 import matplotlib.pyplot as plt
 
 
-# Sütunları saklamak için boş listeler
-time = []
-throughput = []
-average_rtt = []
-packet_loss = []
+def read_metrics(file_name):
+    """TcpRlMetricsWriter dosyasını (tcp-rl-metrics.h) kopyalamadan
+    numpy yapısal dizisi olarak eşler, sütunlar alan adlarıyla okunur"""
+    with open(file_name, "rb") as file:
+        magic, version, header_size, record_size = struct.unpack("<4sIII", file.read(16))
+        fields = file.read(header_size - 16).rstrip(b"\0").decode()
+    if magic != b"TRLM" or version != 1:
+        raise ValueError("Not a metrics file: " + file_name)
 
+    dtype = np.dtype([(name, "<" + code) for name, code in
+                      (field.split(":") for field in fields.split(","))])
+    if dtype.itemsize != record_size:
+        raise ValueError("Record size does not match the fields in " + file_name)
 
+    count = (os.path.getsize(file_name) - header_size) // record_size
+    if count == 0:
+        return np.zeros(0, dtype=dtype)
+    return np.memmap(file_name, dtype=dtype, mode="r", offset=header_size, shape=(count,))
 
-# Dosyayı aç ve oku
-with open("performance_metrics.txt", "r") as file:
-    for line in file:
-        # Başlıkları atlamak için kontrol
-        if line.strip().startswith("Time"):
-            continue
-        
-        # Satırı virgüle göre ayır
-        columns = line.strip().split(",")
-        
-        # Her sütunu uygun listeye ekle
-        time.append(float(columns[0]))
-        throughput.append(float(columns[1])/10000000)
-        average_rtt.append(float(columns[2])*24)
-        packet_loss.append(int(columns[3]))
+
+# Sütunlar
+metrics = read_metrics("performance_metrics.bin")
+time = metrics["time"]
+throughput = metrics["throughput"] / 10000000
+average_rtt = metrics["avgRtt"] * 24
+packet_loss = metrics["packetLoss"]
+fairness = metrics["fairness"]
+
+# Akış bazında seriler (flow_metrics.bin), her aralıkta akış başına bir kayıt
+flow_metrics = read_metrics("flow_metrics.bin")
+flow_ids = np.unique(flow_metrics["flowId"])
 
 rl_tp = []  # TP değerleri için
 rl_rtt = [] # RTT değerleri için
@@ -91,4 +103,25 @@ percent_differences = [
 average_percent_difference = sum(percent_differences) / len(percent_differences)
 print(f"RL RTT, New Reno RTT'ye göre ortalama olarak % {average_percent_difference:.2f} daha düşük.")
 
+# Akış bazında throughput grafiği, ACK akışları da listede
+plt.figure(figsize=(12, 6))
+for flow_id in flow_ids:
+    flow = flow_metrics[flow_metrics["flowId"] == flow_id]
+    plt.plot(flow["time"], flow["throughput"], label="Flow %d (socket %d)" % (flow_id, flow["socketUuid"][-1]))
+plt.xlabel("Time (s)")
+plt.ylabel("Throughput (bps)")
+plt.title("Per-flow Throughput over Time")
+plt.grid()
+plt.legend()
+plt.savefig("contrib/opengym/examples/TCP-RL/graphs/flow_throughput_over_time.png")  # Grafiği kaydet
+plt.show()
+
+# Jain adalet indeksi, sadece aktif veri akışı olan aralıklar
+active = metrics["activeFlows"] > 0
+if active.any():
+    print(f"Ortalama Jain adalet indeksi: {fairness[active].mean():.3f}")
 
+# Sonlu akışların tamamlanma süreleri (data_mbytes verildiyse)
+if os.path.exists("flow_fct.bin"):
+    for record in read_metrics("flow_fct.bin"):
+        print(f"Flow {record['flowId']} (sink {record['sinkId']}) FCT: {record['fct']:.3f} s")
@@ -1,6 +1,9 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
 #include "ns3/internet-module.h"
@@ -12,22 +15,33 @@
 #include "ns3/enum.h"
 #include "ns3/event-id.h"
 #include "ns3/flow-monitor-helper.h"
-#include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/ipv4-static-routing-helper.h"
 #include "ns3/traffic-control-module.h"
 
 #include "ns3/opengym-module.h"
 #include "tcp-rl.h"
+#include "tcp-rl-metrics.h"
+#include "tcp-rl-profiler.h"
+#include "tcp-rl-bench.h"
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE ("TcpVariantsComparison");
 
 static std::vector<uint32_t> rxPkts;
+static std::vector<uint64_t> rxBytes;
+// sink'in tüm veriyi aldığı zaman, sonlu akışlarda (data_mbytes > 0), yoksa -1
+static std::vector<double> sinkDoneTime;
+static uint64_t flowBytes = 0;
 
 static void
 CountRxPkts(uint32_t sinkId, Ptr<const Packet> packet, const Address & srcAddr)
 {
   rxPkts[sinkId]++;
+  rxBytes[sinkId] += packet->GetSize();
+  if (flowBytes > 0 && rxBytes[sinkId] >= flowBytes && sinkDoneTime[sinkId] < 0) {
+    sinkDoneTime[sinkId] = Simulator::Now().GetSeconds();
+  }
 }
 
 static void
@@ -36,58 +50,275 @@ PrintRxCount()
   uint32_t size = rxPkts.size();
   NS_LOG_UNCOND("RxPkts:");
   for (uint32_t i=0; i<size; i++){
-    NS_LOG_UNCOND("---SinkId: "<< i << " RxPkts: " << rxPkts.at(i));
+    NS_LOG_UNCOND("---SinkId: "<< i << " RxPkts: " << rxPkts.at(i) << " RxBytes: " << rxBytes.at(i));
+    if (sinkDoneTime.at(i) >= 0) {
+      NS_LOG_UNCOND("---SinkId: "<< i << " Completed at: " << sinkDoneTime.at(i) << "s");
+    }
   }
 }
 struct PerformanceMetrics {
   double time;
-  double throughput;
-  double avgRtt;
-  uint32_t packetLoss;
+  double throughput;    // bps in the last interval
+  double avgRtt;        // mean delay of the packets received in the last interval
+  double fairness;      // Jain's index of the data flows active in the last interval
+  uint32_t packetLoss;  // packets lost in the last interval
+  uint32_t activeFlows; // data flows that sent or received in the last interval
+};
+// performance_metrics.bin kayıt düzeni, parse_metrics.py bununla okuyor
+static const char *PERFORMANCE_METRICS_FIELDS = "time:f8,throughput:f8,avgRtt:f8,fairness:f8,packetLoss:u4,activeFlows:u4";
+
+// one record per flow and interval
+struct FlowMetrics {
+  double time;
+  double throughput;    // bps in the last interval
+  double delay;         // mean delay of the packets received in the last interval
+  uint32_t flowId;
+  uint32_t socketUuid;  // uuid of the sender's RL env, 0 without one
+  uint32_t packetLoss;  // packets lost in the last interval
+  uint32_t cWnd;        // sender's congestion window in bytes, 0 if unknown
+};
+static const char *FLOW_METRICS_FIELDS = "time:f8,throughput:f8,delay:f8,flowId:u4,socketUuid:u4,packetLoss:u4,cWnd:u4";
+
+// one record per finished data flow
+struct FlowCompletion {
+  double startTime;     // first packet of the flow (SYN)
+  double endTime;       // last byte at the sink
+  double fct;
+  uint32_t flowId;
+  uint32_t sinkId;
+};
+static const char *FLOW_COMPLETION_FIELDS = "startTime:f8,endTime:f8,fct:f8,flowId:u4,sinkId:u4";
+
+struct MetricsWriters {
+  TcpRlMetricsWriter aggregate;   // performance_metrics.bin
+  TcpRlMetricsWriter flows;       // flow_metrics.bin
+  TcpRlMetricsWriter completions; // flow_fct.bin, only with data_mbytes
 };
 
-void CollectMetrics(Ptr<FlowMonitor> monitor, double currentTime, std::vector<PerformanceMetrics>& metrics) {
-  double totalThroughput = 0.0;
-  double totalRTT = 0.0;
-  double totalPacketLoss = 0.0;
-  uint32_t totalPacketsReceived = 0;
+// FlowMonitor counters at the previous sample, indexed by FlowId
+struct FlowCounters {
+  uint64_t rxBytes {0};
+  uint32_t txPackets {0};
+  uint32_t rxPackets {0};
+  uint32_t lostPackets {0};
+  Time delaySum;
+  // filled when the flow is first seen
+  bool resolved {false};
+  Ptr<TcpSocketDerived> socket; // sender
+  int32_t sinkId {-1};          // -1 for ACK flows
+  bool completed {false};
+};
+static std::vector<FlowCounters> prevFlowCounters;
+// veri akışları sink adresi ve portundan ayırt ediliyor, adres -> sinkId
+static std::unordered_map<uint32_t, uint32_t> sinkIds;
+static uint16_t sinkPort = 0;
+
+static FlowCounters &
+GetFlowCounters(FlowId flowId, Ptr<Ipv4FlowClassifier> classifier)
+{
+  if (flowId >= prevFlowCounters.size()) {
+    prevFlowCounters.resize(flowId + 1);
+  }
+  FlowCounters &prev = prevFlowCounters[flowId];
+  if (!prev.resolved) {
+    Ipv4FlowClassifier::FiveTuple tuple = classifier->FindFlow(flowId);
+    prev.socket = TcpSocketDerived::LookupSocket(tuple.sourceAddress, tuple.sourcePort);
+    if (tuple.destinationPort == sinkPort) {
+      std::unordered_map<uint32_t, uint32_t>::const_iterator sink = sinkIds.find(tuple.destinationAddress.Get());
+      if (sink != sinkIds.end()) {
+        prev.sinkId = sink->second;
+      }
+    }
+    prev.resolved = true;
+  }
+  return prev;
+}
+
+static void
+ReportCompletion(FlowId flowId, const FlowMonitor::FlowStats &flow, FlowCounters &prev, TcpRlMetricsWriter *writer)
+{
+  if (prev.sinkId < 0 || prev.completed || sinkDoneTime[prev.sinkId] < 0) {
+    return;
+  }
+  double startTime = flow.timeFirstTxPacket.GetSeconds();
+  double endTime = sinkDoneTime[prev.sinkId];
+  FlowCompletion fc = {startTime, endTime, endTime - startTime, flowId, static_cast<uint32_t>(prev.sinkId)};
+  writer->Write(&fc);
+  prev.completed = true;
+}
 
-  auto stats = monitor->GetFlowStats();
+static void
+SampleFlows(Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier, double interval, MetricsWriters *writers) {
+  double now = Simulator::Now().GetSeconds();
+  uint64_t rxBytes = 0;
+  uint32_t rxPackets = 0;
+  uint32_t lostPackets = 0;
+  Time delaySum;
+  // Jain: (sum x)^2 / (n * sum x^2)
+  double rateSum = 0.0;
+  double rateSquareSum = 0.0;
+  uint32_t activeFlows = 0;
+
+  // sadece son aralıktaki farklar, istatistik haritası kopyalanmıyor
+  const FlowMonitor::FlowStatsContainer &stats = monitor->GetFlowStats();
   for (auto iter = stats.begin(); iter != stats.end(); ++iter) {
-    double flowThroughput = iter->second.rxBytes * 8.0 / currentTime; // Throughput hesaplama
-    totalThroughput += flowThroughput;
+    FlowCounters &prev = GetFlowCounters(iter->first, classifier);
+    const FlowMonitor::FlowStats &flow = iter->second;
+
+    uint64_t flowRxBytes = flow.rxBytes - prev.rxBytes;
+    uint32_t flowTxPackets = flow.txPackets - prev.txPackets;
+    uint32_t flowRxPackets = flow.rxPackets - prev.rxPackets;
+    uint32_t flowLostPackets = flow.lostPackets - prev.lostPackets;
+    Time flowDelaySum = flow.delaySum - prev.delaySum;
+
+    rxBytes += flowRxBytes;
+    rxPackets += flowRxPackets;
+    lostPackets += flowLostPackets;
+    delaySum += flowDelaySum;
+
+    double rate = flowRxBytes * 8.0 / interval;
+    if (prev.sinkId >= 0 && (flowTxPackets > 0 || flowRxPackets > 0)) {
+      rateSum += rate;
+      rateSquareSum += rate * rate;
+      activeFlows++;
+    }
 
-    double flowRTT = iter->second.rxPackets > 0 ? iter->second.delaySum.GetSeconds() / iter->second.rxPackets : 0.0; // Ortalama RTT
-    totalRTT += iter->second.delaySum.GetSeconds();
+    uint32_t socketUuid = 0;
+    uint32_t cWnd = 0;
+    if (prev.socket) {
+      Ptr<TcpRlBase> rl = DynamicCast<TcpRlBase>(prev.socket->GetCongestionControlAlgorithm());
+      socketUuid = rl ? rl->GetSocketUuid() : 0;
+      cWnd = prev.socket->GetCongestionWindow();
+    }
+    double delay = flowRxPackets > 0 ? flowDelaySum.GetSeconds() / flowRxPackets : 0.0;
+    FlowMetrics fm = {now, rate, delay, iter->first, socketUuid, flowLostPackets, cWnd};
+    writers->flows.Write(&fm);
 
-    totalPacketLoss += iter->second.lostPackets;
-    totalPacketsReceived += iter->second.rxPackets;
+    ReportCompletion(iter->first, flow, prev, &writers->completions);
+
+    prev.rxBytes = flow.rxBytes;
+    prev.txPackets = flow.txPackets;
+    prev.rxPackets = flow.rxPackets;
+    prev.lostPackets = flow.lostPackets;
+    prev.delaySum = flow.delaySum;
   }
 
-  // Toplam metrikleri kaydediyoruz
-  if (totalPacketsReceived > 0) {
-    
-    PerformanceMetrics pm = {currentTime, totalThroughput, totalRTT / totalPacketsReceived, static_cast<uint32_t>(totalPacketLoss)};
-    metrics.push_back(pm);
+  // ilk akış başladıktan sonra her aralık kaydediliyor, boş aralıklar dahil
+  if (!stats.empty()) {
+    double avgRtt = rxPackets > 0 ? delaySum.GetSeconds() / rxPackets : 0.0;
+    // hiç veri taşımayan aktif akışlar eşit paylaşmış sayılıyor
+    double fairness = rateSquareSum > 0 ? rateSum * rateSum / (activeFlows * rateSquareSum) : (activeFlows ? 1.0 : 0.0);
+    PerformanceMetrics pm = {now, rxBytes * 8.0 / interval, avgRtt, fairness, lostPackets, activeFlows};
+    writers->aggregate.Write(&pm);
   }
+}
 
-  // 0.1 saniye sonra tekrar bu fonksiyonu çağırıyoruz
-  Simulator::Schedule(Seconds(0.1), &CollectMetrics, monitor, currentTime + 0.1, std::ref(metrics));
+void CollectMetrics(Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier, double interval, MetricsWriters *writers) {
+  SampleFlows(monitor, classifier, interval, writers);
+  Simulator::Schedule(Seconds(interval), &CollectMetrics, monitor, classifier, interval, writers);
+}
+
+// erken biten bölümler: ajan soketlerinin hepsi başlayıp hepsi bittiyse kalan süre boşa gidiyor,
+// geç başlayan akışlar henüz başlamadıysa beklenir
+static void
+StopWhenEpisodesOver(uint32_t socketNum, double interval)
+{
+  if (TcpGymEnv::GetStartedNum() >= socketNum && !TcpGymEnv::GetRunningNum()) {
+    Simulator::Stop();
+    return;
+  }
+  Simulator::Schedule(Seconds(interval), &StopWhenEpisodesOver, socketNum, interval);
 }
 
+// son aralıkta biten akışlar için
+static void
+ReportCompletions(Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier, TcpRlMetricsWriter *writer)
+{
+  const FlowMonitor::FlowStatsContainer &stats = monitor->GetFlowStats();
+  for (auto iter = stats.begin(); iter != stats.end(); ++iter) {
+    ReportCompletion(iter->first, iter->second, GetFlowCounters(iter->first, classifier), writer);
+  }
+}
 
-void SaveMetricsToFile(const std::vector<PerformanceMetrics>& metrics) {
-  std::ofstream outputFile("performance_metrics.txt", std::ios::out);
-  outputFile << "Time (s), Throughput (bps), Average RTT (s), Packet Loss (packets)" << std::endl;
+// --episodes ile her bölüm kendi dosyasına yazıyor: flow_metrics.bin -> flow_metrics.3.bin
+static std::string
+EpisodeFileName(std::string fileName, uint32_t episode, uint32_t episodes)
+{
+  if (episodes <= 1 || fileName.empty()) {
+    return fileName;
+  }
+  std::string::size_type dot = fileName.rfind('.');
+  if (dot == std::string::npos || fileName.find('/', dot) != std::string::npos) {
+    dot = fileName.size();
+  }
+  return fileName.substr(0, dot) + "." + std::to_string(episode) + fileName.substr(dot);
+}
 
-  for (const auto& metric : metrics) {
-    outputFile << metric.time << ", "
-               << metric.throughput << ", "
-               << metric.avgRtt << ", "
-               << metric.packetLoss << std::endl;
+// koşu sonu özeti, benchmark.py her koşudan bir JSON satırı okuyor
+static void
+WriteSummary(std::string fileName, std::string parameters, Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier,
+             double duration, double wall, uint64_t events)
+{
+  // goodput and fairness from the bytes the sinks got
+  uint64_t sinkBytes = 0;
+  double sinkBytesSquareSum = 0.0;
+  for (uint32_t i = 0; i < rxBytes.size(); i++) {
+    sinkBytes += rxBytes[i];
+    sinkBytesSquareSum += static_cast<double>(rxBytes[i]) * rxBytes[i];
+  }
+  double fairness = sinkBytesSquareSum > 0 ? static_cast<double>(sinkBytes) * sinkBytes / (rxBytes.size() * sinkBytesSquareSum) : 0.0;
+
+  // delay and loss of the data flows, the delay histograms share their bin width
+  uint32_t txPackets = 0;
+  uint32_t rxPackets = 0;
+  uint32_t lostPackets = 0;
+  Time delaySum;
+  std::vector<uint64_t> delayBins;
+  double binWidth = 0.0;
+  const FlowMonitor::FlowStatsContainer &stats = monitor->GetFlowStats();
+  for (auto iter = stats.begin(); iter != stats.end(); ++iter) {
+    if (GetFlowCounters(iter->first, classifier).sinkId < 0) {
+      continue;
+    }
+    const FlowMonitor::FlowStats &flow = iter->second;
+    txPackets += flow.txPackets;
+    rxPackets += flow.rxPackets;
+    lostPackets += flow.lostPackets;
+    delaySum += flow.delaySum;
+    // GetBinCount is not const
+    Histogram delayHistogram = flow.delayHistogram;
+    if (delayHistogram.GetNBins() > delayBins.size()) {
+      delayBins.resize(delayHistogram.GetNBins(), 0);
+    }
+    for (uint32_t i = 0; i < delayHistogram.GetNBins(); i++) {
+      delayBins[i] += delayHistogram.GetBinCount(i);
+      binWidth = delayHistogram.GetBinWidth(i);
+    }
+  }
+  double p95Delay = 0.0;
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < delayBins.size(); i++) {
+    seen += delayBins[i];
+    if (seen >= 0.95 * rxPackets) {
+      p95Delay = (i + 0.5) * binWidth;
+      break;
+    }
   }
 
-  outputFile.close();
+  std::ofstream summary(fileName.c_str(), std::ios::app);
+  NS_ABORT_MSG_UNLESS(summary, "Cannot open " << fileName);
+  summary << "{" << parameters
+          << ", \"simulated_s\": " << duration
+          << ", \"goodput_bps\": " << (duration > 0 ? sinkBytes * 8.0 / duration : 0.0)
+          << ", \"mean_delay_s\": " << (rxPackets ? delaySum.GetSeconds() / rxPackets : 0.0)
+          << ", \"p95_delay_s\": " << p95Delay
+          << ", \"loss_rate\": " << (txPackets ? static_cast<double>(lostPackets) / txPackets : 0.0)
+          << ", \"fairness\": " << fairness
+          << ", \"wall_s\": " << wall
+          << ", \"events\": " << events
+          << ", \"events_per_s\": " << (wall > 0 ? events / wall : 0.0)
+          << ", \"sim_wall_ratio\": " << (wall > 0 ? duration / wall : 0.0)
+          << "}" << std::endl;
 }
 
 
@@ -104,54 +335,215 @@ int main (int argc, char *argv[])
   std::string bottleneck_delay = "0.01ms";
   std::string access_bandwidth = "10Mbps";
   std::string access_delay = "20ms";
+  std::string access_delay_max = "";
+  double flow_start_gap = 0.1;
+  double flow_start_jitter = 0.0;
   double duration = 10.0;
+  uint32_t episodes = 1;
   
   std::string prefix_file_name = "TcpVariantsComparison";
   uint64_t data_mbytes = 0;
   uint32_t mtu_bytes = 400;
   uint32_t run = 0;
+  uint32_t simSeed = 1;
   bool flow_monitor = true;
   bool sack = true;
+  uint32_t tcp_buffer = 1 << 21;
+  double queue_bdp = 1.0;
+  std::string scenario = "";
   std::string queue_disc_type = "ns3::PfifoFastQueueDisc";
   std::string recovery = "ns3::TcpClassicRecovery";
 
   double rew = 1.0;
   double pen = -1.0;
+  bool batched_env = false;
+  bool async_env = false;
+  double metrics_interval = 0.1;
+  std::string shm_file = "";
+  std::string policy_file = "policy.bin";
+  bool profile = false;
+  double profile_interval = 0.0;
+  uint32_t microbench = 0;
+  std::string local_agent = "";
+  std::string summary_file = "";
+  std::string record_file = "";
+  std::string replay_file = "";
+  std::string dataset_baseline = "TcpNewReno";
+  std::string dataset_file = "dataset.bin";
+  std::string feature_set = "Full";
+  std::string action_mode = "Absolute";
+  std::string fallback = "TcpNewReno";
+  double action_deadline = 0.0;
+  uint32_t cwnd_collapse = 0;
+  bool zero_goodput_stop = false;
+  double rtt_limit = 0.0;
+  double termination_patience = 1.0;
+  std::string reward_utility = "Legacy";
+  double latency_slo = 0.0;
 
   CommandLine cmd;
 
 
-  cmd.AddValue ("transport_prot", "Transport protocol to use: TcpNewReno, TcpRlTimeBased", transport_prot);
+  cmd.AddValue ("transport_prot", "Transport protocol to use: TcpNewReno, TcpRl, TcpRlTimeBased, TcpRlPolicy, TcpRlDataset", transport_prot);
+  cmd.AddValue ("nLeaf", "Number of left and right side leaf nodes, one flow each", nLeaf);
+  cmd.AddValue ("bottleneck_bandwidth", "Bottleneck bandwidth", bottleneck_bandwidth);
+  cmd.AddValue ("bottleneck_delay", "Bottleneck delay", bottleneck_delay);
+  cmd.AddValue ("error_p", "Packet error rate on the bottleneck", error_p);
+  cmd.AddValue ("access_bandwidth", "Leaf link bandwidth", access_bandwidth);
+  cmd.AddValue ("access_delay", "Leaf link delay", access_delay);
+  cmd.AddValue ("access_delay_max", "Draw every leaf link delay uniformly between access_delay and this", access_delay_max);
+  cmd.AddValue ("flow_start_gap", "Seconds between the starts of consecutive flows", flow_start_gap);
+  cmd.AddValue ("flow_start_jitter", "Random delay of every flow start, uniform up to this many seconds", flow_start_jitter);
+  cmd.AddValue ("queue_disc", "Bottleneck queue disc, e.g. ns3::PfifoFastQueueDisc, ns3::FqCoDelQueueDisc, ns3::RedQueueDisc", queue_disc_type);
+  cmd.AddValue ("sack", "Enable TCP SACK", sack);
+  cmd.AddValue ("recovery", "TCP recovery algorithm, e.g. ns3::TcpClassicRecovery or ns3::TcpPrrRecovery", recovery);
+  cmd.AddValue ("mtu", "Size of IP packets to send in bytes", mtu_bytes);
+  cmd.AddValue ("data", "Number of Megabytes of data to transmit, 0 for unlimited", data_mbytes);
+  cmd.AddValue ("tcp_buffer", "TCP send and receive buffer size in bytes", tcp_buffer);
+  cmd.AddValue ("queue_bdp", "Bottleneck queue size in bandwidth-delay products", queue_bdp);
+  cmd.AddValue ("scenario", "Link and buffer preset, other options override it: HighBdp1G, HighBdp10G, Large1k, Large10k", scenario);
+  cmd.AddValue ("duration", "Time to allow flows to run in seconds", duration);
+  cmd.AddValue ("run", "Run index (for setting repeatable seeds)", run);
+  cmd.AddValue ("episodes", "Episodes to run in this process, each rebuilds the scenario with run + episode and waits for the agent reset", episodes);
+  cmd.AddValue ("simSeed", "Seed of the random number generator", simSeed);
+  cmd.AddValue ("openGymPort", "Port of the agent connection, one per parallel simulation", openGymPort);
+  cmd.AddValue ("local_agent", "In-process stand-in for the agent of the RL protocols, e.g. TcpRlNewRenoAgent", local_agent);
+  cmd.AddValue ("summary_file", "Append the end of run summary to this file as a JSON line", summary_file);
+  cmd.AddValue ("record_file", "Record every agent exchange of the RL protocols to this trace", record_file);
+  cmd.AddValue ("replay_file", "Apply the actions of a recorded trace instead of running the agent", replay_file);
+  cmd.AddValue ("dataset_baseline", "Congestion control observed by TcpRlDataset, e.g. TcpCubic or TcpBbr", dataset_baseline);
+  cmd.AddValue ("dataset_file", "Offline transitions written by TcpRlDataset", dataset_file);
+  cmd.AddValue ("feature_set", "Observation features of the RL protocols: Minimal, Basic, Full, Extended", feature_set);
+  cmd.AddValue ("action_mode", "Actions of the RL protocols: Absolute, Additive, Multiplicative, Pacing, Segments, Log2", action_mode);
+  cmd.AddValue ("fallback", "Congestion control of the RL protocols until the first action and after late or out of bounds ones, e.g. TcpCubic or TcpBbr", fallback);
+  cmd.AddValue ("action_deadline", "Wall clock time in ms the agent has for one exchange, 0 for none", action_deadline);
+  cmd.AddValue ("cwnd_collapse", "End a socket's episode when its cWnd stays below this many segments, 0 for never", cwnd_collapse);
+  cmd.AddValue ("zero_goodput_stop", "End a socket's episode when it gets no ACK", zero_goodput_stop);
+  cmd.AddValue ("rtt_limit", "End a socket's episode when its RTT stays above this many times minRtt, 0 for never", rtt_limit);
+  cmd.AddValue ("termination_patience", "Seconds an early termination condition has to hold", termination_patience);
+  cmd.AddValue ("reward_utility", "Reward of the RL protocols: Legacy, Power, Copa, Vivace, LogThroughput", reward_utility);
+  cmd.AddValue ("latency_slo", "Latency objective in ms penalized by the reward, 0 for none", latency_slo);
+  cmd.AddValue ("batched_env", "Exchange all TcpRlTimeBased sockets with the agent in one step", batched_env);
+  cmd.AddValue ("async_env", "Overlap the agent exchange with the simulation, actions lag one step", async_env);
+  cmd.AddValue ("shm_file", "Exchange with the agent through this shared memory file instead of ZMQ", shm_file);
+  cmd.AddValue ("metrics_interval", "FlowMonitor sampling interval in seconds", metrics_interval);
+  cmd.AddValue ("policy_file", "Exported policy used by TcpRlPolicy", policy_file);
+  cmd.AddValue ("profile", "Measure agent round trips and congestion control callbacks, print a summary at the end", profile);
+  cmd.AddValue ("profile_interval", "Also write profile.bin every this many simulated seconds, 0 for the summary only", profile_interval);
+  cmd.AddValue ("microbench", "Run the hot path microbenchmarks with this many iterations after a TcpNewReno simulation", microbench);
+
+  // senaryo önce uygulanır, komut satırındaki diğer değerler onu ezer
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg.compare (0, 11, "--scenario=") == 0)
+    {
+      scenario = arg.substr (11);
+    }
+  }
+  if (scenario == "HighBdp1G" || scenario == "HighBdp10G")
+  {
+    // 50 ms RTT, BDP 6.25 MB (1 Gbps) / 62.5 MB (10 Gbps)
+    bottleneck_bandwidth = scenario == "HighBdp1G" ? "1Gbps" : "10Gbps";
+    bottleneck_delay = "5ms";
+    access_bandwidth = scenario == "HighBdp1G" ? "10Gbps" : "40Gbps";
+    access_delay = "10ms";
+    mtu_bytes = 1500;
+    tcp_buffer = 1 << 27;
+  }
+  else if (scenario == "Large1k" || scenario == "Large10k")
+  {
+    // 1000 / 10000 akış, akış başına 1 Mbps, 30-70 ms RTT, başlangıçlar 1 saniyeye yayılıyor
+    nLeaf = scenario == "Large1k" ? 1000 : 10000;
+    bottleneck_bandwidth = scenario == "Large1k" ? "1Gbps" : "10Gbps";
+    bottleneck_delay = "5ms";
+    access_bandwidth = "100Mbps";
+    access_delay = "5ms";
+    access_delay_max = "15ms";
+    flow_start_gap = 1.0 / nLeaf;
+    flow_start_jitter = 0.01;
+    mtu_bytes = 1500;
+  }
+  else if (!scenario.empty ())
+  {
+    NS_ABORT_MSG ("Unknown scenario " << scenario);
+  }
+
   cmd.Parse (argc, argv);
 
+  if (microbench > 0)
+  {
+    // simülasyon sadece FlowMonitor verisi için, RL yolları sentetik girdilerle ölçülüyor
+    transport_prot = "TcpNewReno";
+  }
+
   transport_prot = std::string ("ns3::") + transport_prot;
 
-  SeedManager::SetSeed (1);
+  SeedManager::SetSeed (simSeed);
   SeedManager::SetRun (run);
 
 // TCP olarak hangi algoritma kullanılacağını seçiyor
   NS_LOG_UNCOND("Ns3Env parameters:");
-  if (transport_prot.compare ("ns3::TcpRlTimeBased") == 0)
+  if (transport_prot.compare ("ns3::TcpRlTimeBased") == 0 || transport_prot.compare ("ns3::TcpRl") == 0)
   {
     NS_LOG_UNCOND("--openGymPort: " << openGymPort);
   } else {
     NS_LOG_UNCOND("--openGymPort: No OpenGym");
   }
 
-  NS_LOG_UNCOND("--seed: " << run);
+  NS_LOG_UNCOND("--seed: " << simSeed << " --run: " << run);
+  if (episodes > 1)
+  {
+    NS_LOG_UNCOND("--episodes: " << episodes);
+  }
   NS_LOG_UNCOND("--Tcp version: " << transport_prot);
 
 
 
   // OpenGym Env ns3-gym için gerekli ortam 
-  Ptr<OpenGymInterface> openGymInterface;
-  if (transport_prot.compare ("ns3::TcpRlTimeBased") == 0)
+  bool openGym = false;
+  if (!local_agent.empty ())
+  {
+    // ajan süreci yerine yerel vekil, benchmark.py bununla çalıştırıyor
+    ObjectFactory agentFactory;
+    agentFactory.SetTypeId ("ns3::" + local_agent);
+    Config::SetDefault ("ns3::TcpRlBase::LocalAgent", PointerValue (agentFactory.Create<TcpGymLocalAgent> ()));
+  }
+  Config::SetDefault ("ns3::TcpRlBase::FeatureSet", StringValue (feature_set)); // gönderilen gözlem alanları
+  Config::SetDefault ("ns3::TcpRlBase::ActionMode", StringValue (action_mode)); // mutlak, göreli ya da hız eylemleri
+  Config::SetDefault ("ns3::TcpRlBase::Fallback", TypeIdValue (TypeId::LookupByName ("ns3::" + fallback))); // ajan eylemi yokken pencereyi yönetir
+  Config::SetDefault ("ns3::TcpRlBase::ActionDeadline", TimeValue (MilliSeconds (action_deadline))); // geç gelen eylemler atılır
+  // bozulan bölümler erken biter, tüm soketler bitince simülasyon durur
+  Config::SetDefault ("ns3::TcpRlBase::CwndCollapse", UintegerValue (cwnd_collapse));
+  Config::SetDefault ("ns3::TcpRlBase::ZeroGoodputStop", BooleanValue (zero_goodput_stop));
+  Config::SetDefault ("ns3::TcpRlBase::RttLimit", DoubleValue (rtt_limit));
+  Config::SetDefault ("ns3::TcpRlBase::TerminationPatience", TimeValue (Seconds (termination_patience)));
+  // ödül C++ tarafında hesaplanıyor, Legacy ortamların kendi ödül/cezası
+  Config::SetDefault ("ns3::TcpRlReward::Utility", StringValue (reward_utility));
+  Config::SetDefault ("ns3::TcpRlReward::LatencySlo", TimeValue (MilliSeconds (latency_slo)));
+  if (transport_prot.compare ("ns3::TcpRl") == 0 && local_agent.empty () && replay_file.empty ())
   {
-    openGymInterface = OpenGymInterface::Get(openGymPort);
+    // olay tabanlı ortamlar da openGymPort'a bağlanıyor, paralel simülasyonlar farklı port kullanıyor
+    openGym = true;
+  }
+  if (transport_prot.compare ("ns3::TcpRlTimeBased") == 0 || transport_prot.compare ("ns3::TcpRlPolicy") == 0
+      || transport_prot.compare ("ns3::TcpRlDataset") == 0)
+  {
+    if (transport_prot.compare ("ns3::TcpRlTimeBased") == 0 && shm_file.empty () && local_agent.empty () && replay_file.empty ())
+    {
+      openGym = true;
+    }
+    Config::SetDefault ("ns3::TcpRlBase::ShmFile", StringValue (shm_file)); // ZMQ yerine paylaşılan bellek
+    Config::SetDefault ("ns3::TcpRlPolicy::PolicyFile", StringValue (policy_file)); // ajan yerine yerel politika
+    Config::SetDefault ("ns3::TcpRlDataset::Baseline", TypeIdValue (TypeId::LookupByName ("ns3::" + dataset_baseline))); // pencereyi yöneten klasik algoritma
     Config::SetDefault ("ns3::TcpRlTimeBased::StepTime", TimeValue (Seconds(tcpEnvTimeStep))); // adım değeri
     Config::SetDefault ("ns3::TcpRlTimeBased::Duration", TimeValue (Seconds(duration))); // zaman değeri
     Config::SetDefault ("ns3::TcpRlTimeBased::Reward", DoubleValue (rew)); // ödül
     Config::SetDefault ("ns3::TcpRlTimeBased::Penalty", DoubleValue (pen)); // ceza
+    Config::SetDefault ("ns3::TcpRlTimeBased::Batched", BooleanValue (batched_env)); // tüm soketler tek adımda
+    Config::SetDefault ("ns3::TcpRlTimeBased::BatchSize", UintegerValue (nLeaf)); // her gönderici bir satır
+    Config::SetDefault ("ns3::TcpRlTimeBased::Async", BooleanValue (async_env)); // eylemler bir adım gecikmeli
+    Config::SetDefault ("ns3::TcpRlTimeBased::AgentPort", UintegerValue (openGymPort)); // gecikmeli değişim kendi bağlantısıyla
   }
 
   // Calculate the ADU size
@@ -170,9 +562,9 @@ int main (int argc, char *argv[])
   double start_time = 0.1; 
   double stop_time = start_time + duration;
 
-  // 4 MB  TCP buffer
-  Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue (1 << 21));
-  Config::SetDefault ("ns3::TcpSocket::SndBufSize", UintegerValue (1 << 21));
+  // TCP buffer, at least one BDP for windows that fill the bottleneck
+  Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue (tcp_buffer));
+  Config::SetDefault ("ns3::TcpSocket::SndBufSize", UintegerValue (tcp_buffer));
   Config::SetDefault ("ns3::TcpSocketBase::Sack", BooleanValue (sack));
   
   Config::SetDefault ("ns3::TcpSocket::DelAckCount", UintegerValue (2));
@@ -193,111 +585,246 @@ int main (int argc, char *argv[])
       Config::SetDefault ("ns3::TcpL4Protocol::SocketType", TypeIdValue (TypeId::LookupByName (transport_prot)));
     }
 
-  // error modeli kurulumu
-  Ptr<UniformRandomVariable> uv = CreateObject<UniformRandomVariable> ();
-  uv->SetStream (50);
-  RateErrorModel error_model;
-  error_model.SetRandomVariable (uv);
-  error_model.SetUnit (RateErrorModel::ERROR_UNIT_PACKET);
-  error_model.SetRate (error_p);
+    NS_ABORT_MSG_UNLESS (episodes >= 1, "episodes must be at least 1");
+  // her bölüm senaryoyu aynı süreçte baştan kuruyor, TypeId kayıtları ve ayarlar korunuyor
+  for (uint32_t episode = 0; episode < episodes; episode++)
+  {
+    if (episode > 0)
+    {
+      // Simulator::Destroy düğümleri, kanalları ve soketleri siliyor; adresler burada sıfırlanıyor
+      Ipv4AddressGenerator::Reset ();
+      NS_LOG_UNCOND("--episode: " << episode << " --run: " << run + episode);
+    }
+    SeedManager::SetRun (run + episode);
 
-  //  point-to-point bağlantılarını kur
-  PointToPointHelper bottleNeckLink;
-  bottleNeckLink.SetDeviceAttribute  ("DataRate", StringValue (bottleneck_bandwidth));
-  bottleNeckLink.SetChannelAttribute ("Delay", StringValue (bottleneck_delay));
+    // ajan kararlarını kaydet ya da kayıttan ajansız tekrar oynat, her bölüm kendi dosyasıyla
+    Config::SetDefault ("ns3::TcpRlBase::RecordFile", StringValue (EpisodeFileName (record_file, episode, episodes)));
+    Config::SetDefault ("ns3::TcpRlBase::ReplayFile", StringValue (EpisodeFileName (replay_file, episode, episodes)));
+    Config::SetDefault ("ns3::TcpRlDataset::DatasetFile", StringValue (EpisodeFileName (dataset_file, episode, episodes))); // çevrimdışı eğitim verisi
 
-  PointToPointHelper pointToPointLeaf;
-  pointToPointLeaf.SetDeviceAttribute  ("DataRate", StringValue (access_bandwidth));
-  pointToPointLeaf.SetChannelAttribute ("Delay", StringValue (access_delay));
+    // önceki bölümün arayüzü Simulator::Destroy ile silindi, ajan reset() ile aynı porttan yenisini bekliyor
+    Ptr<OpenGymInterface> openGymInterface;
+    if (openGym)
+    {
+      openGymInterface = OpenGymInterface::Get(openGymPort);
+    }
 
-  PointToPointDumbbellHelper d (nLeaf, pointToPointLeaf,
-                                nLeaf, pointToPointLeaf,
-                                bottleNeckLink);
+    // error modeli kurulumu
+    Ptr<UniformRandomVariable> uv = CreateObject<UniformRandomVariable> ();
+    uv->SetStream (50);
+    RateErrorModel error_model;
+    error_model.SetRandomVariable (uv);
+    error_model.SetUnit (RateErrorModel::ERROR_UNIT_PACKET);
+    error_model.SetRate (error_p);
+
+    // her yaprak bağlantısı kendi /30 ağında, 10.1.0.0/16 ve 10.2.0.0/16 içinde
+    NS_ABORT_MSG_UNLESS (nLeaf >= 1 && nLeaf <= 16384, "nLeaf must be between 1 and 16384");
+
+    //  point-to-point bağlantılarını kur
+    PointToPointHelper bottleNeckLink;
+    bottleNeckLink.SetDeviceAttribute  ("DataRate", StringValue (bottleneck_bandwidth));
+    bottleNeckLink.SetChannelAttribute ("Delay", StringValue (bottleneck_delay));
+    if (error_p > 0.0)
+    {
+      bottleNeckLink.SetDeviceAttribute ("ReceiveErrorModel", PointerValue (&error_model));
+    }
 
-  // Ip stacklerini yükle 
-  InternetStackHelper stack;
-  stack.InstallAll ();
+    PointToPointHelper pointToPointLeaf;
+    pointToPointLeaf.SetDeviceAttribute  ("DataRate", StringValue (access_bandwidth));
+    pointToPointLeaf.SetChannelAttribute ("Delay", StringValue (access_delay));
 
+    PointToPointDumbbellHelper d (nLeaf, pointToPointLeaf,
+                                  nLeaf, pointToPointLeaf,
+                                  bottleNeckLink);
 
-  TrafficControlHelper tchPfifo;
-  tchPfifo.SetRootQueueDisc ("ns3::PfifoFastQueueDisc");
+    // Ip stacklerini yükle
+    InternetStackHelper stack;
+    stack.InstallAll ();
+    // RL algoritmaları soketlerini, akış metrikleri de cwnd'yi TcpSocketDerived kaydından bulur,
+    // uygulamalar soketlerini bu fabrikayla açıyor
+    TcpSocketDerivedFactory::InstallAll ();
 
 
+    // yaprak gecikmeleri farklıysa her bağlantı için ayrı çekiliyor
+    if (!access_delay_max.empty ())
+    {
+      Ptr<UniformRandomVariable> delayRv = CreateObject<UniformRandomVariable> ();
+      delayRv->SetStream (51);
+      double minDelay = Time (access_delay).GetSeconds ();
+      double maxDelay = Time (access_delay_max).GetSeconds ();
+      for (uint32_t i = 0; i < nLeaf; i++)
+      {
+        d.GetLeft (i)->GetDevice (0)->GetChannel ()->SetAttribute ("Delay", TimeValue (Seconds (delayRv->GetValue (minDelay, maxDelay))));
+        d.GetRight (i)->GetDevice (0)->GetChannel ()->SetAttribute ("Delay", TimeValue (Seconds (delayRv->GetValue (minDelay, maxDelay))));
+      }
+    }
 
-  DataRate access_b (access_bandwidth);
-  DataRate bottle_b (bottleneck_bandwidth);
-  Time access_d (access_delay);
-  Time bottle_d (bottleneck_delay);
+    DataRate access_b (access_bandwidth);
+    DataRate bottle_b (bottleneck_bandwidth);
+    Time access_d (access_delay);
+    Time bottle_d (bottleneck_delay);
 
-  uint32_t size = static_cast<uint32_t>((std::min (access_b, bottle_b).GetBitRate () / 8) *
-    ((access_d + bottle_d + access_d) * 2).GetSeconds ());
+    uint32_t size = static_cast<uint32_t>((std::min (access_b, bottle_b).GetBitRate () / 8) *
+      ((access_d + bottle_d + access_d) * 2).GetSeconds () * queue_bdp);
 
-  Config::SetDefault ("ns3::PfifoFastQueueDisc::MaxSize",
-                      QueueSizeValue (QueueSize (QueueSizeUnit::PACKETS, size / mtu_bytes)));
+    // darboğaz kuyruğu, yönlendiricilerin 0. cihazı darboğaz bağlantısı
+    TrafficControlHelper tchBottleneck;
+    tchBottleneck.SetRootQueueDisc (queue_disc_type,
+                                    "MaxSize", QueueSizeValue (QueueSize (QueueSizeUnit::PACKETS, size / mtu_bytes)));
+    tchBottleneck.Install (d.GetLeft()->GetDevice(0));
+    tchBottleneck.Install (d.GetRight()->GetDevice(0));
 
-    tchPfifo.Install (d.GetLeft()->GetDevice(1));
-    tchPfifo.Install (d.GetRight()->GetDevice(1));
-  
 
-  // Ip adresi atamaları
-  d.AssignIpv4Addresses (Ipv4AddressHelper ("10.1.1.0", "255.255.255.0"),
-                         Ipv4AddressHelper ("10.2.1.0", "255.255.255.0"),
-                         Ipv4AddressHelper ("10.3.1.0", "255.255.255.0"));
+    // Ip adresi atamaları
+    d.AssignIpv4Addresses (Ipv4AddressHelper ("10.1.0.0", "255.255.255.252"),
+                           Ipv4AddressHelper ("10.2.0.0", "255.255.255.252"),
+                           Ipv4AddressHelper ("10.3.0.0", "255.255.255.252"));
 
 
-  NS_LOG_INFO ("Initialize Global Routing.");
-  Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+    // global yönlendirme tabloları düğüm sayısının karesiyle büyüyor, statik yollar yaprak sayısıyla
+    NS_LOG_INFO ("Initialize Static Routing.");
+    Ipv4StaticRoutingHelper staticRouting;
+    staticRouting.GetStaticRouting (d.GetLeft ()->GetObject<Ipv4> ())
+      ->AddNetworkRouteTo (Ipv4Address ("10.2.0.0"), Ipv4Mask ("255.255.0.0"), Ipv4Address ("10.3.0.2"), 1);
+    staticRouting.GetStaticRouting (d.GetRight ()->GetObject<Ipv4> ())
+      ->AddNetworkRouteTo (Ipv4Address ("10.1.0.0"), Ipv4Mask ("255.255.0.0"), Ipv4Address ("10.3.0.1"), 1);
+    for (uint32_t i = 0; i < nLeaf; i++)
+    {
+      // /30 ağında yaprak .1, yönlendirici .2
+      staticRouting.GetStaticRouting (d.GetLeft (i)->GetObject<Ipv4> ())
+        ->SetDefaultRoute (Ipv4Address (d.GetLeftIpv4Address (i).Get () + 1), 1);
+      staticRouting.GetStaticRouting (d.GetRight (i)->GetObject<Ipv4> ())
+        ->SetDefaultRoute (Ipv4Address (d.GetRightIpv4Address (i).Get () + 1), 1);
+    }
 
-  // sağ ve sol node'lara veri atamaları  
-  uint16_t port = 50000;
-  Address sinkLocalAddress (InetSocketAddress (Ipv4Address::GetAny (), port));
-  PacketSinkHelper sinkHelper ("ns3::TcpSocketFactory", sinkLocalAddress);
-  ApplicationContainer sinkApps;
-  for (uint32_t i = 0; i < d.RightCount (); ++i)
-  {
-    sinkHelper.SetAttribute ("Protocol", TypeIdValue (TcpSocketFactory::GetTypeId ()));
-    sinkApps.Add (sinkHelper.Install (d.GetRight (i)));
-  }
-  sinkApps.Start (Seconds (0.0));
-  sinkApps.Stop  (Seconds (stop_time));
+    // sağ ve sol node'lara veri atamaları
+    uint16_t port = 50000;
+    Address sinkLocalAddress (InetSocketAddress (Ipv4Address::GetAny (), port));
+    PacketSinkHelper sinkHelper ("ns3::TcpSocketDerivedFactory", sinkLocalAddress);
+    ApplicationContainer sinkApps;
+    for (uint32_t i = 0; i < d.RightCount (); ++i)
+    {
+      sinkHelper.SetAttribute ("Protocol", TypeIdValue (TcpSocketDerivedFactory::GetTypeId ()));
+      sinkApps.Add (sinkHelper.Install (d.GetRight (i)));
+    }
+    sinkApps.Start (Seconds (0.0));
+    sinkApps.Stop  (Seconds (stop_time));
+
+    // sink sayaçları ve akış tamamlanma süreleri
+    sinkPort = port;
+    flowBytes = data_mbytes * 1000000;
+    rxPkts.assign (d.RightCount (), 0);
+    rxBytes.assign (d.RightCount (), 0);
+    sinkDoneTime.assign (d.RightCount (), -1.0);
+    for (uint32_t i = 0; i < d.RightCount (); ++i)
+    {
+      sinkIds[d.GetRightIpv4Address (i).Get ()] = i;
+      sinkApps.Get (i)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&CountRxPkts, i));
+    }
 
-  for (uint32_t i = 0; i < d.LeftCount (); ++i)
-  {
-    
-    AddressValue remoteAddress (InetSocketAddress (d.GetRightIpv4Address (i), port));
+    // akışlar flow_start_gap aralıklarla, flow_start_jitter kadar rastgele gecikmeyle başlıyor
+    Ptr<UniformRandomVariable> startRv = CreateObject<UniformRandomVariable> ();
+    startRv->SetStream (52);
     Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue (tcp_adu_size));
-    BulkSendHelper ftp ("ns3::TcpSocketFactory", Address ());
-    ftp.SetAttribute ("Remote", remoteAddress);
+    BulkSendHelper ftp ("ns3::TcpSocketDerivedFactory", Address ());
     ftp.SetAttribute ("SendSize", UintegerValue (tcp_adu_size));
     ftp.SetAttribute ("MaxBytes", UintegerValue (data_mbytes * 1000000));
+    for (uint32_t i = 0; i < d.LeftCount (); ++i)
+    {
+      AddressValue remoteAddress (InetSocketAddress (d.GetRightIpv4Address (i), port));
+      ftp.SetAttribute ("Remote", remoteAddress);
+
+      ApplicationContainer clientApp = ftp.Install (d.GetLeft (i));
+      double jitter = flow_start_jitter > 0 ? startRv->GetValue (0.0, flow_start_jitter) : 0.0;
+      double client_start = flow_start_gap * i + jitter;
+      // kuyruklar son 3 saniyede boşalıyor, kısa sürelerde en fazla sürenin yarısı
+      double client_stop = std::max (client_start, stop_time - std::min (3.0, duration / 2));
+      clientApp.Start (Seconds (client_start));
+      clientApp.Stop (Seconds (client_stop));
+    }
 
-    ApplicationContainer clientApp = ftp.Install (d.GetLeft (i));
-    clientApp.Start (Seconds (start_time * i)); 
-    clientApp.Stop (Seconds (stop_time - 3)); 
-  }
 
-   
     FlowMonitorHelper flowHelper;
+    // p95 gecikme için 0.1 ms çözünürlük
+    flowHelper.SetMonitorAttribute ("DelayBinWidth", DoubleValue (0.0001));
     Ptr<FlowMonitor> monitor = flowHelper.InstallAll();
-    
-    
-    std::vector<PerformanceMetrics> metrics;
-    Simulator::Schedule(Seconds(0.1), &CollectMetrics, monitor, 0.1, std::ref(metrics));
-  
+    Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowHelper.GetClassifier ());
+
+
+    // örnekler çalışma sırasında arka planda dosyaya yazılıyor
+    MetricsWriters metricsWriters;
+    NS_ABORT_MSG_UNLESS (metricsWriters.aggregate.Open (EpisodeFileName ("performance_metrics.bin", episode, episodes), PERFORMANCE_METRICS_FIELDS, sizeof (PerformanceMetrics)),
+                         "Cannot open performance_metrics.bin");
+    NS_ABORT_MSG_UNLESS (metricsWriters.flows.Open (EpisodeFileName ("flow_metrics.bin", episode, episodes), FLOW_METRICS_FIELDS, sizeof (FlowMetrics)),
+                         "Cannot open flow_metrics.bin");
+    if (flowBytes > 0)
+    {
+      NS_ABORT_MSG_UNLESS (metricsWriters.completions.Open (EpisodeFileName ("flow_fct.bin", episode, episodes), FLOW_COMPLETION_FIELDS, sizeof (FlowCompletion)),
+                           "Cannot open flow_fct.bin");
+    }
+    Simulator::Schedule(Seconds(metrics_interval), &CollectMetrics, monitor, classifier, metrics_interval, &metricsWriters);
+
+    if (profile)
+    {
+      TcpRlProfiler::Enable (profile_interval, EpisodeFileName ("profile.bin", episode, episodes));
+    }
+
+    if (transport_prot.compare (0, 10, "ns3::TcpRl") == 0 && (cwnd_collapse > 0 || zero_goodput_stop || rtt_limit > 0))
+    {
+      // her gönderici bir ajan soketi
+      Simulator::Schedule(Seconds(tcpEnvTimeStep), &StopWhenEpisodesOver, d.LeftCount (), tcpEnvTimeStep);
+    }
     Simulator::Stop(Seconds(duration));
+    uint64_t runStart = TcpRlProfiler::GetWallTime();
     Simulator::Run();
-  
+    double runWall = (TcpRlProfiler::GetWallTime() - runStart) * 1e-9;
+
     monitor->CheckForLostPackets();
+    ReportCompletions(monitor, classifier, &metricsWriters.completions);
 
-    SaveMetricsToFile(metrics);
+    if (!summary_file.empty())
+    {
+      std::ostringstream parameters;
+      parameters << "\"transport_prot\": \"" << transport_prot.substr (5) << "\""
+                 << ", \"local_agent\": \"" << local_agent << "\""
+                 << ", \"bottleneck_bandwidth\": \"" << bottleneck_bandwidth << "\""
+                 << ", \"bottleneck_delay\": \"" << bottleneck_delay << "\""
+                 << ", \"error_p\": " << error_p
+                 << ", \"nLeaf\": " << nLeaf
+                 << ", \"scenario\": \"" << scenario << "\""
+                 << ", \"queue_disc\": \"" << queue_disc_type << "\""
+                 << ", \"run\": " << run + episode
+                 << ", \"episode\": " << episode
+                 << ", \"duration\": " << duration;
+      // ajan soketleri erken bittiyse simülasyon duration'dan önce durmuştur
+      WriteSummary(summary_file, parameters.str(), monitor, classifier, Simulator::Now().GetSeconds(), runWall, Simulator::GetEventCount());
+    }
 
+    metricsWriters.aggregate.Close();
+    metricsWriters.flows.Close();
+    metricsWriters.completions.Close();
 
-  if ( transport_prot.compare ("ns3::TcpRlTimeBased") == 0)
-  {
-    openGymInterface->NotifySimulationEnd();
-  }
+    if (microbench > 0 && episode + 1 == episodes)
+    {
+      MetricsWriters benchWriters;
+      benchWriters.aggregate.Open ("/dev/null", PERFORMANCE_METRICS_FIELDS, sizeof (PerformanceMetrics));
+      benchWriters.flows.Open ("/dev/null", FLOW_METRICS_FIELDS, sizeof (FlowMetrics));
+      TcpRlMicrobench::Run (microbench);
+      TcpRlMicrobench::Measure ("CollectMetrics (" + std::to_string (monitor->GetFlowStats ().size ()) + " flows)", microbench,
+                                [&] { SampleFlows (monitor, classifier, metrics_interval, &benchWriters); });
+    }
 
-  PrintRxCount();
-  Simulator::Destroy ();
+
+    if (openGymInterface)
+    {
+      openGymInterface->NotifySimulationEnd();
+    }
+
+    PrintRxCount();
+    // sayaçlar soketleri tutuyor, statik yıkımda soket kaydı çoktan silinmiş olur
+    prevFlowCounters.clear ();
+    sinkIds.clear ();
+    Simulator::Destroy ();
+  }
   return 0;
 }
@@ -0,0 +1,285 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""sim.cc'yi tüm çekirdeklerde paralel koşturan tarama aracı.
+
+Her süreç kendi --run, --simSeed ve --openGymPort değeriyle, kendi çalışma
+dizininde başlar (performance_metrics.bin gibi çıktılar çakışmaz).
+VecNs3Env bu süreçleri ajana tek bir vektör ortam olarak sunar: step()
+tüm eylemleri gönderir, tüm gözlemleri birlikte döndürür. Simülasyonlar
+birbirini beklemeden paralel ilerler, biten simülasyon bir sonraki
+--run değeriyle yeniden başlatılır.
+
+Örnek (ns-3 kök dizininden):
+  python3 contrib/opengym/examples/TCP-RL/sweep.py --envs 8 --steps 1000 \\
+      --sim_args "--transport_prot=TcpRlTimeBased --duration=100"
+  python3 contrib/opengym/examples/TCP-RL/sweep.py --envs 8 --seeds 32 --no_agent \\
+      --sim_args "--transport_prot=TcpRlTimeBased --local_agent=TcpRlNewRenoAgent"
+
+Ajan içinden:
+  from sweep import VecNs3Env
+  env = VecNs3Env(8, sim_args="--transport_prot=TcpRlTimeBased")
+  obs = env.reset()                       # (8, gözlem) ya da liste
+  obs, rewards, dones, infos = env.step(actions)
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+DEFAULT_SIM_CMD = './ns3 run --no-build --cwd={cwd} "sim {args}"'
+
+
+class SimProcess(object):
+	"""Bir sim.cc süreci: kendi portu, tohumu ve çalışma dizini"""
+	def __init__(self, sim_cmd, sim_args, index, run, seed, port, out_dir):
+		super(SimProcess, self).__init__()
+		self.index = index
+		self.run = run
+		self.seed = seed
+		self.port = port
+		self.cwd = os.path.abspath(os.path.join(out_dir, "env%d" % index))
+		os.makedirs(self.cwd, exist_ok=True)
+		args = "%s --run=%d --simSeed=%d --openGymPort=%d --summary_file=%s" % (
+			sim_args, run, seed, port, os.path.join(self.cwd, "summary.jsonl"))
+		self.log = open(os.path.join(self.cwd, "sim.log"), "a")
+		self.proc = subprocess.Popen(sim_cmd.format(args=args, cwd=self.cwd), shell=True,
+									stdout=self.log, stderr=subprocess.STDOUT)
+
+	def wait(self):
+		code = self.proc.wait()
+		self.log.close()
+		return code
+
+	def kill(self):
+		if self.proc.poll() is None:
+			self.proc.kill()
+		self.wait()
+
+
+class VecNs3Env(object):
+	"""N paralel sim.cc sürecini tek vektör ortam olarak sunar.
+
+	Gözlemler aynı şekildeyse (N, ...) dizisi, değilse (ör. farklı soket
+	sayılı batched ortamlar) liste olarak döner. Biten ortamın son gözlemi
+	done=True ile döner, sonraki step() onu yeni --run ile yeniden başlatır
+	ve eylemini yok sayar."""
+	def __init__(self, env_num, sim_args="", sim_cmd=DEFAULT_SIM_CMD, base_port=5555,
+				 base_run=0, base_seed=1, out_dir="sweep_out", shm=False):
+		super(VecNs3Env, self).__init__()
+		self.env_num = env_num
+		self.sim_args = sim_args
+		self.sim_cmd = sim_cmd
+		self.base_port = base_port
+		self.base_seed = base_seed
+		self.out_dir = out_dir
+		self.shm = shm
+		self.next_run = base_run
+		# yeniden başlatmalar iş parçacıklarında, sayaçlar kilitli
+		self.lock = threading.Lock()
+		self.procs = [None] * env_num
+		self.envs = [None] * env_num
+		self.restart = [False] * env_num
+		self.episodes = 0
+		# ZMQ beklemesi GIL'i bırakıyor, her ortam kendi iş parçacığında
+		self.pool = ThreadPoolExecutor(max_workers=env_num)
+		self.observation_space = None
+		self.action_space = None
+
+	def _start(self, i):
+		port = self.base_port + i
+		sim_args = self.sim_args
+		shm_file = None
+		if self.shm:
+			shm_file = os.path.abspath(os.path.join(self.out_dir, "env%d" % i, "exchange.shm"))
+			if os.path.exists(shm_file):
+				os.remove(shm_file)
+			sim_args += " --shm_file=" + shm_file
+		with self.lock:
+			run = self.next_run
+			self.next_run += 1
+		self.procs[i] = SimProcess(self.sim_cmd, sim_args, i, run, self.base_seed + run, port, self.out_dir)
+		if shm_file:
+			from tcp_base import ShmEnv
+			self.envs[i] = ShmEnv(shm_file)
+		else:
+			from ns3gym import ns3env
+			self.envs[i] = ns3env.Ns3Env(port=port, startSim=False)
+		if self.observation_space is None:
+			self.observation_space = self.envs[i].observation_space
+			self.action_space = self.envs[i].action_space
+		return self.envs[i].reset()
+
+	def _finish(self, i):
+		if self.envs[i] is not None:
+			self.envs[i].close()
+			self.envs[i] = None
+		if self.procs[i] is not None:
+			self.procs[i].wait()
+			self.procs[i] = None
+		with self.lock:
+			self.episodes += 1
+
+	def _step_one(self, i, action):
+		if self.restart[i]:
+			self.restart[i] = False
+			self._finish(i)
+			return self._start(i), 0.0, False, ""
+		obs, reward, done, info = self.envs[i].step(action)
+		self.restart[i] = bool(done)
+		return obs, reward, done, info
+
+	@staticmethod
+	def _stack(obs):
+		arrays = [np.asarray(o) for o in obs]
+		if all(a.shape == arrays[0].shape for a in arrays):
+			return np.stack(arrays)
+		return arrays
+
+	def reset(self):
+		obs = list(self.pool.map(self._start, range(self.env_num)))
+		return self._stack(obs)
+
+	def step(self, actions):
+		results = list(self.pool.map(self._step_one, range(self.env_num), actions))
+		obs, rewards, dones, infos = zip(*results)
+		return self._stack(obs), np.asarray(rewards, dtype=np.float32), np.asarray(dones), list(infos)
+
+	def close(self):
+		for i in range(self.env_num):
+			if self.envs[i] is not None:
+				self.envs[i].close()
+				self.envs[i] = None
+			if self.procs[i] is not None:
+				self.procs[i].kill()
+				self.procs[i] = None
+		self.pool.shutdown()
+
+
+def read_summaries(out_dir):
+	"""tüm süreçlerin --summary_file satırları"""
+	rows = []
+	for name in sorted(os.listdir(out_dir)):
+		path = os.path.join(out_dir, name, "summary.jsonl")
+		if os.path.exists(path):
+			with open(path) as file:
+				rows += [json.loads(line) for line in file if line.strip()]
+	return rows
+
+
+def run_agent(args):
+	"""tcp_base ajanları ile vektör ortamı sürer, adım/saniye ölçer"""
+	from tcp_base import TcpTimeBased, TcpEventBased, TcpTimeBasedBatch
+
+	env = VecNs3Env(args.envs, args.sim_args, args.sim_cmd, args.base_port,
+					args.base_run, args.base_seed, args.out_dir, args.shm)
+	# her sim için UUID -> ajan, satırlar UUID ile ayrılıyor
+	agents = [TcpTimeBasedBatch() for _ in range(args.envs)]
+	single = {0: TcpEventBased, 1: TcpTimeBased}
+	try:
+		obs = env.reset()
+		for i, agent in enumerate(agents):
+			agent.set_spaces(env.observation_space, env.action_space)
+			row = np.asarray(obs[i])
+			if row.ndim == 1:
+				# tek soketli ortam: tip sütunu ajanı seçiyor
+				agent.agent_class = single[int(row[1])]
+		rewards = np.zeros(args.envs, dtype=np.float32)
+		infos = [""] * args.envs
+		start = time.time()
+		for step in range(args.steps):
+			actions = [agents[i].get_action(obs[i], rewards[i], False, infos[i]) for i in range(args.envs)]
+			obs, rewards, dones, infos = env.step(actions)
+		wall = time.time() - start
+		print("%d envs, %d steps, %.1f steps/s, %d finished simulations" % (
+			args.envs, args.steps * args.envs, args.steps * args.envs / wall, env.episodes))
+	finally:
+		env.close()
+
+
+def run_no_agent(args):
+	"""ajansız koşular (klasik protokoller, --local_agent), en fazla --envs süreç"""
+	running = []
+	for seed in range(args.seeds):
+		# ilk biten sürecin yerine yenisi
+		while len(running) >= args.envs:
+			for proc in [p for p in running if p.proc.poll() is not None]:
+				proc.wait()
+				running.remove(proc)
+			time.sleep(0.05)
+		run = args.base_run + seed
+		running.append(SimProcess(args.sim_cmd, args.sim_args, seed, run, args.base_seed + run,
+								  args.base_port + seed % args.envs, args.out_dir))
+		print("[%d/%d] --run=%d" % (seed + 1, args.seeds, run), file=sys.stderr)
+	for proc in running:
+		proc.wait()
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Paralel sim.cc taraması ve vektör ortam')
+	parser.add_argument('--envs',
+						type=int,
+						default=os.cpu_count() or 1,
+						help='Paralel simülasyon sayısı, Varsayılan: çekirdek sayısı')
+	parser.add_argument('--sim_cmd',
+						type=str,
+						default=DEFAULT_SIM_CMD,
+						help='sim.cc programını çalıştıran komut, {args} ve {cwd} yerine argümanlar ve çalışma dizini gelir')
+	parser.add_argument('--sim_args',
+						type=str,
+						default='--transport_prot=TcpRlTimeBased',
+						help='Tüm simülasyonların ortak argümanları')
+	parser.add_argument('--base_port',
+						type=int,
+						default=5555,
+						help='İlk ortamın OpenGym portu, i. ortam base_port + i, Varsayılan: 5555')
+	parser.add_argument('--base_run',
+						type=int,
+						default=0,
+						help='İlk --run değeri, her yeni simülasyon bir artırır, Varsayılan: 0')
+	parser.add_argument('--base_seed',
+						type=int,
+						default=1,
+						help='--simSeed = base_seed + run, Varsayılan: 1')
+	parser.add_argument('--steps',
+						type=int,
+						default=100,
+						help='Ortam başına adım sayısı, Varsayılan: 100')
+	parser.add_argument('--shm',
+						action='store_true',
+						help='ZMQ yerine paylaşılan bellek (--shm_file), ortam başına bir dosya')
+	parser.add_argument('--no_agent',
+						action='store_true',
+						help='Ajansız koşular, --seeds tane simülasyon --envs paralellikle')
+	parser.add_argument('--seeds',
+						type=int,
+						default=0,
+						help='--no_agent ile koşu sayısı, Varsayılan: --envs')
+	parser.add_argument('--out_dir',
+						type=str,
+						default='sweep_out',
+						help='Ortam başına çalışma dizinlerinin kökü, Varsayılan: sweep_out')
+	args = parser.parse_args()
+	if not args.seeds:
+		args.seeds = args.envs
+
+	os.makedirs(args.out_dir, exist_ok=True)
+	if args.no_agent:
+		run_no_agent(args)
+	else:
+		run_agent(args)
+
+	summaries = read_summaries(args.out_dir)
+	if summaries:
+		with open(os.path.join(args.out_dir, "summary.json"), "w") as file:
+			json.dump(summaries, file, indent=1)
+		print("%d summaries in %s" % (len(summaries), os.path.join(args.out_dir, "summary.json")))
+
+
+if __name__ == "__main__":
+	main()
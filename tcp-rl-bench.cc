@@ -0,0 +1,151 @@
+#include "tcp-rl-bench.h"
+#include "tcp-rl.h"
+#include "tcp-rl-env.h"
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/packet.h"
+#include "ns3/tcp-header.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// counted only between CountAllocs (true) and CountAllocs (false)
+static std::atomic<bool> g_countAllocs (false);
+static std::atomic<uint64_t> g_allocNum (0);
+
+void *
+operator new (std::size_t size)
+{
+  if (g_countAllocs.load (std::memory_order_relaxed)) {
+    g_allocNum.fetch_add (1, std::memory_order_relaxed);
+  }
+  void *p = std::malloc (size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc ();
+  }
+  return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+  std::free (p);
+}
+
+void
+operator delete (void *p, std::size_t) noexcept
+{
+  std::free (p);
+}
+
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ns3::TcpRlMicrobench");
+
+static const uint32_t SEGMENT_SIZE = 536;
+
+// answers every observation with the same action, stands in for the agent
+class TcpRlBenchAgent : public TcpGymLocalAgent
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlBenchAgent ()
+  {
+    std::vector<uint32_t> shape = {2,};
+    m_action = CreateObject<OpenGymBoxContainer<uint32_t> > (shape);
+    m_action->AddValue (64 * SEGMENT_SIZE);
+    m_action->AddValue (10 * SEGMENT_SIZE);
+  }
+
+  virtual Ptr<OpenGymDataContainer> GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver)
+  {
+    return m_action;
+  }
+
+private:
+  Ptr<OpenGymBoxContainer<uint32_t> > m_action;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (TcpRlBenchAgent);
+
+TypeId
+TcpRlBenchAgent::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlBenchAgent")
+    .SetParent<TcpGymLocalAgent> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpRlBenchAgent> ()
+  ;
+  return tid;
+}
+
+void
+TcpRlMicrobench::CountAllocs (bool count)
+{
+  g_countAllocs.store (count, std::memory_order_relaxed);
+}
+
+uint64_t
+TcpRlMicrobench::GetAllocNum ()
+{
+  return g_allocNum.load (std::memory_order_relaxed);
+}
+
+void
+TcpRlMicrobench::Report (std::string name, uint64_t iterations, uint64_t wallTime, uint64_t allocNum)
+{
+  NS_LOG_UNCOND ("---" << name << ": " << static_cast<double> (wallTime) / iterations << " ns/op "
+                 << static_cast<double> (allocNum) / iterations << " allocs/op");
+}
+
+void
+TcpRlMicrobench::Run (uint64_t iterations)
+{
+  NS_LOG_FUNCTION (iterations);
+  NS_LOG_UNCOND ("Microbench: " << iterations << " iterations");
+  Ptr<TcpRlBenchAgent> agent = CreateObject<TcpRlBenchAgent> ();
+
+  // a socket that is never connected, only its TcpSocketState is used
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<TcpSocketDerived> socket = CreateObject<TcpSocketDerived> ();
+  socket->SetNode (node);
+  Ptr<TcpSocketState> tcb = socket->GetTcb ();
+  tcb->m_segmentSize = SEGMENT_SIZE;
+  tcb->m_cWnd = 10 * SEGMENT_SIZE;
+  tcb->m_ssThresh = 64 * SEGMENT_SIZE;
+  tcb->m_bytesInFlight = 5 * SEGMENT_SIZE;
+  Time rtt = MilliSeconds (40);
+  Ptr<const Packet> packet = Create<Packet> (SEGMENT_SIZE);
+  TcpHeader header;
+
+  // TcpRlBase dispatch into its time-step env, Init registers the traces
+  Ptr<TcpRlTimeBased> cc = CreateObject<TcpRlTimeBased> ();
+  cc->Init (tcb);
+  Ptr<TcpTimeStepGymEnv> stepEnv = DynamicCast<TcpTimeStepGymEnv> (cc->GetGymEnv ());
+  stepEnv->SetLocalAgent (agent);
+  Measure ("TcpRlBase::PktsAcked", iterations, [&] { cc->PktsAcked (tcb, 1, rtt); });
+  Measure ("TcpRlBase::IncreaseWindow", iterations, [&] { cc->IncreaseWindow (tcb, 1); });
+  Measure ("TcpRlBase::GetSsThresh", iterations, [&] { cc->GetSsThresh (tcb, tcb->m_bytesInFlight); });
+  Measure ("TcpRlBase::CongestionStateSet", iterations, [&] { cc->CongestionStateSet (tcb, TcpSocketState::CA_OPEN); });
+  Measure ("TcpRlBase::CwndEvent", iterations, [&] { cc->CwndEvent (tcb, TcpSocketState::CA_EVENT_TX_START); });
+
+  // time-step env, the clock does not move so the inter packet sums stay empty
+  Ptr<OpenGymDataContainer> action = agent->GetAction (0, 0.0, false);
+  Measure ("TcpTimeStepGymEnv::GetObservation", iterations, [&] { stepEnv->GetObservation (); });
+  Measure ("TcpTimeStepGymEnv::ExecuteActions", iterations, [&] { stepEnv->ExecuteActions (action); });
+  Measure ("TcpTimeStepGymEnv::TxPktTrace", iterations, [&] { stepEnv->TxPktTrace (packet, header, socket); });
+  Measure ("TcpTimeStepGymEnv::RxPktTrace", iterations, [&] { stepEnv->RxPktTrace (packet, header, socket); });
+
+  // event env, every ACK is an agent round trip
+  Ptr<TcpEventGymEnv> eventEnv = CreateObject<TcpEventGymEnv> ();
+  eventEnv->SetLocalAgent (agent);
+  Measure ("TcpEventGymEnv::IncreaseWindow", iterations, [&] { eventEnv->IncreaseWindow (tcb, 1); });
+  Measure ("TcpEventGymEnv::PktsAcked", iterations, [&] { eventEnv->PktsAcked (tcb, 1, rtt); });
+  Measure ("TcpEventGymEnv::GetObservation", iterations, [&] { eventEnv->GetObservation (); });
+  Measure ("TcpEventGymEnv::TxPktTrace", iterations, [&] { eventEnv->TxPktTrace (packet, header, socket); });
+  Measure ("TcpEventGymEnv::RxPktTrace", iterations, [&] { eventEnv->RxPktTrace (packet, header, socket); });
+}
+
+} // namespace ns3
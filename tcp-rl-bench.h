@@ -0,0 +1,55 @@
+#ifndef TCP_RL_BENCH_H
+#define TCP_RL_BENCH_H
+
+#include "tcp-rl-profiler.h"
+#include <stdint.h>
+#include <string>
+
+namespace ns3 {
+
+
+/*
+Microbenchmarks of the per-ACK paths (sim --microbench): TcpRlBase callback
+dispatch, observation building, action decoding and the packet traces,
+driven with a synthetic TcpSocketState and an in-process agent instead of
+the OpenGymInterface. Reports wall ns/op and heap allocations/op.
+
+Allocations are counted by replacing the global operator new, which only
+counts while a benchmark runs.
+*/
+class TcpRlMicrobench
+{
+public:
+  // times iterations calls of op, after one warm-up call that may
+  // create the containers later calls reuse
+  template <typename F>
+  static void Measure (std::string name, uint64_t iterations, F op);
+
+  // all env and congestion control benchmarks
+  static void Run (uint64_t iterations);
+
+private:
+  static void CountAllocs (bool count);
+  static uint64_t GetAllocNum ();
+  static void Report (std::string name, uint64_t iterations, uint64_t wallTime, uint64_t allocNum);
+};
+
+template <typename F>
+void
+TcpRlMicrobench::Measure (std::string name, uint64_t iterations, F op)
+{
+  op ();
+  uint64_t allocNum = GetAllocNum ();
+  CountAllocs (true);
+  uint64_t start = TcpRlProfiler::GetWallTime ();
+  for (uint64_t i = 0; i < iterations; i++) {
+    op ();
+  }
+  uint64_t wallTime = TcpRlProfiler::GetWallTime () - start;
+  CountAllocs (false);
+  Report (name, iterations, wallTime, GetAllocNum () - allocNum);
+}
+
+} // namespace ns3
+
+#endif /* TCP_RL_BENCH_H */
@@ -0,0 +1,136 @@
+#include "tcp-rl-dataset.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ns3::TcpRlDatasetWriter");
+NS_OBJECT_ENSURE_REGISTERED (TcpRlDatasetWriter);
+
+const uint32_t TcpRlDatasetRecord::OBS_NUM;
+
+static std::map<std::string, Ptr<TcpRlDatasetWriter> > g_datasetWriters;
+
+TypeId
+TcpRlDatasetWriter::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlDatasetWriter")
+    .SetParent<TcpGymLocalAgent> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpRlDatasetWriter> ()
+  ;
+
+  return tid;
+}
+
+TcpRlDatasetWriter::TcpRlDatasetWriter ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlDatasetWriter::~TcpRlDatasetWriter ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<TcpRlDatasetWriter>
+TcpRlDatasetWriter::Get (std::string fileName)
+{
+  std::map<std::string, Ptr<TcpRlDatasetWriter> >::iterator it = g_datasetWriters.find (fileName);
+  if (it != g_datasetWriters.end ()) {
+    return it->second;
+  }
+
+  Ptr<TcpRlDatasetWriter> writer = CreateObject<TcpRlDatasetWriter> ();
+  NS_ABORT_MSG_UNLESS (writer->Open (fileName), "Cannot create dataset " << fileName);
+  if (g_datasetWriters.empty ()) {
+    Simulator::ScheduleDestroy (&TcpRlDatasetWriter::CloseAll);
+  }
+  g_datasetWriters[fileName] = writer;
+  return writer;
+}
+
+void
+TcpRlDatasetWriter::CloseAll ()
+{
+  for (std::map<std::string, Ptr<TcpRlDatasetWriter> >::iterator it = g_datasetWriters.begin (); it != g_datasetWriters.end (); ++it) {
+    it->second->Close ();
+  }
+  g_datasetWriters.clear ();
+}
+
+bool
+TcpRlDatasetWriter::Open (std::string fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+  std::ostringstream fields;
+  fields << "time:f8,socketUuid:u4,reward:f4,ssThresh:u4,cWnd:u4";
+  for (uint32_t i = 0; i < TcpRlDatasetRecord::OBS_NUM; i++) {
+    fields << ",obs" << i << ":u8";
+  }
+  for (uint32_t i = 0; i < TcpRlDatasetRecord::OBS_NUM; i++) {
+    fields << ",nextObs" << i << ":u8";
+  }
+  m_fileName = fileName;
+  return m_writer.Open (fileName, fields.str (), sizeof (TcpRlDatasetRecord));
+}
+
+void
+TcpRlDatasetWriter::Close ()
+{
+  NS_LOG_FUNCTION (this);
+  // the last observation of every socket has no successor, it is dropped
+  m_writer.Close ();
+  m_lastObs.clear ();
+  NS_LOG_UNCOND ("Dataset " << m_fileName << ": " << m_recordNum << " transitions");
+}
+
+Ptr<OpenGymDataContainer>
+TcpRlDatasetWriter::GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver)
+{
+  Ptr<OpenGymBoxContainer<uint64_t> > obsBox = DynamicCast<OpenGymBoxContainer<uint64_t> > (obs);
+  std::vector<uint64_t> data = obsBox->GetData ();
+  uint32_t width = GetRowSize (obsBox);
+  NS_ASSERT_MSG (width <= TcpRlDatasetRecord::OBS_NUM, "Datasets are built from time-step observations");
+  uint32_t rowNum = width ? data.size () / width : 0;
+
+  m_actionData.clear ();
+  for (uint32_t r = 0; r < rowNum; r++) {
+    const uint64_t *row = &data[r * width];
+    std::vector<uint64_t> &lastObs = m_lastObs[row[0]];
+    if (!lastObs.empty ()) {
+      m_record.time = Simulator::Now ().GetSeconds ();
+      m_record.socketUuid = row[0];
+      m_record.reward = reward;
+      m_record.ssThresh = row[4];
+      m_record.cWnd = row[5];
+      std::fill (std::copy (lastObs.begin (), lastObs.end (), m_record.obs), m_record.obs + TcpRlDatasetRecord::OBS_NUM, 0);
+      std::fill (std::copy (row, row + width, m_record.nextObs), m_record.nextObs + TcpRlDatasetRecord::OBS_NUM, 0);
+      m_writer.Write (&m_record);
+      m_recordNum++;
+    }
+    lastObs.assign (row, row + width);
+
+    // keep the window of the controller
+    m_actionData.push_back (row[4]);
+    m_actionData.push_back (row[5]);
+  }
+
+  // the action is applied before the next call, the box can be reused
+  if (!m_action || m_actionRowNum != rowNum) {
+    std::vector<uint32_t> shape = {rowNum, 2,};
+    m_action = CreateObject<OpenGymBoxContainer<uint32_t> > (shape);
+    m_actionRowNum = rowNum;
+  }
+  m_action->SetData (m_actionData);
+  Ptr<OpenGymBoxContainer<uint32_t> > action = m_action;
+
+  NS_LOG_INFO ("MyGetAction: " << action);
+  return action;
+}
+
+} // namespace ns3
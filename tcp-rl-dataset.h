@@ -0,0 +1,72 @@
+#ifndef TCP_RL_DATASET_H
+#define TCP_RL_DATASET_H
+
+#include "tcp-rl-env.h"
+#include "tcp-rl-metrics.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace ns3 {
+
+
+/*
+One offline RL transition of one socket: the step t observation, the
+window the controller ended the step with (the implied action), the
+TcpTimeStepGymEnv reward and the step t + 1 observation. Feature sets
+smaller than FEATURES_EXTENDED leave the last values zero.
+*/
+struct TcpRlDatasetRecord
+{
+  static const uint32_t OBS_NUM = TcpTimeStepGymEnv::m_obsParameterMax;
+
+  double time;
+  uint32_t socketUuid;
+  float reward;
+  uint32_t ssThresh;
+  uint32_t cWnd;
+  uint64_t obs[OBS_NUM];
+  uint64_t nextObs[OBS_NUM];
+};
+
+
+/*
+Local agent of TcpRlDataset: never changes the window, it pairs every
+observation with the previous one of the same socket and appends the
+transition through TcpRlMetricsWriter (read_metrics in parse_metrics.py
+reads it, fields obs0.. and nextObs0..). Every process writes its own
+file, so datasets are generated in parallel by running several seeds.
+*/
+class TcpRlDatasetWriter : public TcpGymLocalAgent
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlDatasetWriter ();
+  virtual ~TcpRlDatasetWriter ();
+
+  static Ptr<TcpRlDatasetWriter> Get (std::string fileName);
+  static void CloseAll ();
+
+  bool Open (std::string fileName);
+  void Close ();
+
+  virtual Ptr<OpenGymDataContainer> GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver);
+
+private:
+  TcpRlMetricsWriter m_writer;
+  TcpRlDatasetRecord m_record;
+  std::string m_fileName;
+  uint64_t m_recordNum {0};
+  // last observation of every socket, waits for its next observation
+  std::unordered_map<uint32_t, std::vector<uint64_t> > m_lastObs;
+
+  // reused for every action
+  Ptr<OpenGymBoxContainer<uint32_t> > m_action;
+  std::vector<uint32_t> m_actionData;
+  uint32_t m_actionRowNum {0};
+};
+
+} // namespace ns3
+
+#endif /* TCP_RL_DATASET_H */
@@ -1,4 +1,7 @@
 #include "tcp-rl-env.h"
+#include "tcp-rl-profiler.h"
+#include "tcp-rl-replay.h"
+#include "tcp-rl-reward.h"
 #include "ns3/tcp-header.h"
 #include "ns3/object.h"
 #include "ns3/core-module.h"
@@ -6,14 +9,59 @@
 #include "ns3/simulator.h"
 #include "ns3/tcp-socket-base.h"
 #include <vector>
-#include <numeric>
+#include <algorithm>
+#include <sstream>
+#include <cmath>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <zmq.hpp>
 
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("ns3::TcpGymEnv");
+NS_OBJECT_ENSURE_REGISTERED (TcpGymLocalAgent);
+
+TypeId
+TcpGymLocalAgent::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpGymLocalAgent")
+    .SetParent<Object> ()
+    .SetGroupName ("OpenGym")
+  ;
+
+  return tid;
+}
+
+uint32_t
+TcpGymLocalAgent::GetRowSize (Ptr<OpenGymBoxContainer<uint64_t> > obs)
+{
+  // batched observations are {rows, values}
+  std::vector<uint32_t> shape = obs->GetShape ();
+  if (shape.size () == 2) {
+    return shape[1];
+  }
+  return obs->GetData ().size ();
+}
+
+
 NS_OBJECT_ENSURE_REGISTERED (TcpGymEnv);
 
+// per socket envs of this simulation, registered when their socket is
+// initialized, and those of them that are not over yet
+static uint32_t g_startedEnvNum = 0;
+static std::set<const TcpGymEnv *> g_runningEnvs;
+
+static void
+ClearRunningEnvs ()
+{
+  g_startedEnvNum = 0;
+  g_runningEnvs.clear ();
+}
+
 TcpGymEnv::TcpGymEnv ()
 {
   NS_LOG_FUNCTION (this);
@@ -23,6 +71,7 @@ TcpGymEnv::TcpGymEnv ()
 TcpGymEnv::~TcpGymEnv ()
 {
   NS_LOG_FUNCTION (this);
+  g_runningEnvs.erase (this);
 }
 
 TypeId
@@ -40,6 +89,228 @@ void
 TcpGymEnv::DoDispose ()
 {
   NS_LOG_FUNCTION (this);
+  m_localAgent = 0;
+  m_tcb = 0;
+  m_obsBox = 0;
+  m_obsSpace = 0;
+  m_actionSpace = 0;
+}
+
+void
+TcpGymEnv::SetFeatureSet(FeatureSet_t set)
+{
+  NS_LOG_FUNCTION (this << set);
+  m_featureSet = set;
+  m_obsSpace = 0;
+}
+
+TcpGymEnv::FeatureSet_t
+TcpGymEnv::GetFeatureSet() const
+{
+  return m_featureSet;
+}
+
+void
+TcpGymEnv::SetActionMode(ActionMode_t mode)
+{
+  NS_LOG_FUNCTION (this << mode);
+  m_actionMode = mode;
+  m_actionSpace = 0;
+}
+
+TcpGymEnv::ActionMode_t
+TcpGymEnv::GetActionMode() const
+{
+  return m_actionMode;
+}
+
+uint32_t
+TcpGymEnv::GetActionRowSize(ActionMode_t mode)
+{
+  return mode == ACTION_PACING ? 3 : 2;
+}
+
+uint32_t
+TcpGymEnv::GetActionStride(const std::vector<uint32_t> &shape, ActionMode_t mode)
+{
+  return shape.size () == 2 ? shape[1] : GetActionRowSize(mode);
+}
+
+void
+TcpGymEnv::ApplyPacing(Ptr<TcpSocketState> tcb)
+{
+  if (m_actionMode != ACTION_PACING || !m_new_pacingRate) {
+    return;
+  }
+  tcb->m_pacing = true;
+  tcb->m_pacingRate = DataRate (m_new_pacingRate);
+}
+
+void
+TcpGymEnv::SetActionDeadline(Time deadline)
+{
+  NS_LOG_FUNCTION (this << deadline);
+  m_actionDeadline = deadline;
+}
+
+Time
+TcpGymEnv::GetActionDeadline() const
+{
+  return m_actionDeadline;
+}
+
+bool
+TcpGymEnv::HasAgentAction() const
+{
+  return m_agentAction;
+}
+
+void
+TcpGymEnv::DropAction(bool late)
+{
+  m_agentAction = false;
+  if (late && !m_lateActionNum++) {
+    NS_LOG_WARN ("Socket " << m_socketUuid << " missed the action deadline at " << Simulator::Now ().GetSeconds () << "s");
+  } else if (!late && !m_invalidActionNum++) {
+    NS_LOG_WARN ("Socket " << m_socketUuid << " got an out of bounds action at " << Simulator::Now ().GetSeconds () << "s");
+  }
+}
+
+bool
+TcpGymEnv::PastDeadline(uint64_t start, uint64_t end) const
+{
+  return m_actionDeadline.IsStrictlyPositive ()
+         && end - start > static_cast<uint64_t> (m_actionDeadline.GetNanoSeconds ());
+}
+
+void
+TcpGymEnv::SetCwndCollapse(uint32_t segments)
+{
+  NS_LOG_FUNCTION (this << segments);
+  m_cwndCollapse = segments;
+}
+
+void
+TcpGymEnv::SetZeroGoodputStop(bool value)
+{
+  NS_LOG_FUNCTION (this << value);
+  m_zeroGoodputStop = value;
+}
+
+void
+TcpGymEnv::SetRttLimit(double factor)
+{
+  NS_LOG_FUNCTION (this << factor);
+  m_rttLimit = factor;
+}
+
+void
+TcpGymEnv::SetTerminationPatience(Time value)
+{
+  NS_LOG_FUNCTION (this << value);
+  m_terminationPatience = value;
+}
+
+bool
+TcpGymEnv::IsGameOver() const
+{
+  return m_isGameOver;
+}
+
+void
+TcpGymEnv::Register()
+{
+  NS_LOG_FUNCTION (this);
+  if (m_registered) {
+    return;
+  }
+  m_registered = true;
+  if (!g_startedEnvNum) {
+    Simulator::ScheduleDestroy (&ClearRunningEnvs);
+  }
+  g_startedEnvNum++;
+  g_runningEnvs.insert (this);
+}
+
+uint32_t
+TcpGymEnv::GetStartedNum()
+{
+  return g_startedEnvNum;
+}
+
+uint32_t
+TcpGymEnv::GetRunningNum()
+{
+  return g_runningEnvs.size ();
+}
+
+void
+TcpGymEnv::SetRewardModel(Ptr<TcpRlReward> model)
+{
+  NS_LOG_FUNCTION (this << model);
+  m_rewardModel = model;
+}
+
+float
+TcpGymEnv::ComputeModelReward(Time interval, uint64_t segmentsAcked, uint32_t lossNum, Time rtt, Time prevRtt)
+{
+  TcpRlRewardInput step;
+  step.interval = interval.GetSeconds ();
+  step.throughput = 0.0;
+  step.rttGradient = 0.0;
+  if (step.interval > 0) {
+    step.throughput = 8.0 * segmentsAcked * m_tcb->m_segmentSize / step.interval;
+    if (rtt.IsStrictlyPositive () && prevRtt.IsStrictlyPositive ()) {
+      step.rttGradient = (rtt - prevRtt).GetSeconds () / step.interval;
+    }
+  }
+  step.avgRtt = rtt.GetSeconds ();
+  step.minRtt = m_tcb->m_minRtt != Time::Max () ? m_tcb->m_minRtt.GetSeconds () : 0.0;
+  step.lossRate = 0.0;
+  if (segmentsAcked + lossNum) {
+    step.lossRate = double (lossNum) / (segmentsAcked + lossNum);
+  }
+  return m_rewardModel->Compute (step);
+}
+
+// true once holds has been true for patience, since keeps when it started
+static bool
+Sustained(bool holds, Time &since, Time patience)
+{
+  if (!holds) {
+    since = Seconds (-1);
+    return false;
+  }
+  if (since.IsStrictlyNegative ()) {
+    since = Simulator::Now ();
+  }
+  return Simulator::Now () - since >= patience;
+}
+
+bool
+TcpGymEnv::UpdateGameOver(bool end, uint64_t segmentsAcked, Time rtt)
+{
+  if (m_isGameOver || !m_tcb) {
+    return m_isGameOver;
+  }
+  bool collapse = Sustained (m_cwndCollapse && m_tcb->m_cWnd < m_cwndCollapse * m_tcb->m_segmentSize,
+                             m_cwndCollapseSince, m_terminationPatience);
+  bool noGoodput = Sustained (m_zeroGoodputStop && !segmentsAcked, m_zeroGoodputSince, m_terminationPatience);
+  // minRtt is Time::Max until the first RTT sample
+  bool rttBlowUp = Sustained (m_rttLimit > 0 && rtt.IsStrictlyPositive () && m_tcb->m_minRtt != Time::Max ()
+                              && rtt.GetDouble () > m_rttLimit * m_tcb->m_minRtt.GetDouble (),
+                              m_rttLimitSince, m_terminationPatience);
+  if (!end && !collapse && !noGoodput && !rttBlowUp) {
+    return false;
+  }
+
+  NS_LOG_INFO ("Socket " << m_socketUuid << " game over at " << Simulator::Now ().GetSeconds () << "s:"
+               << (end ? " duration" : "") << (collapse ? " cWnd collapse" : "")
+               << (noGoodput ? " zero goodput" : "") << (rttBlowUp ? " RTT limit" : ""));
+  m_isGameOver = true;
+  m_agentAction = false;
+  g_runningEnvs.erase (this);
+  return true;
 }
 
 void
@@ -56,6 +327,85 @@ TcpGymEnv::SetSocketUuid(uint32_t id)
   m_socketUuid = id;
 }
 
+uint32_t
+TcpGymEnv::GetSocketUuid() const
+{
+  return m_socketUuid;
+}
+
+void
+TcpGymEnv::SetLocalAgent(Ptr<TcpGymLocalAgent> agent)
+{
+  NS_LOG_FUNCTION (this);
+  m_localAgent = agent;
+}
+
+Ptr<TcpGymLocalAgent>
+TcpGymEnv::GetLocalAgent() const
+{
+  return m_localAgent;
+}
+
+void
+TcpGymEnv::SetRecorder(Ptr<TcpRlTraceRecorder> recorder)
+{
+  NS_LOG_FUNCTION (this);
+  m_recorder = recorder;
+}
+
+void
+TcpGymEnv::RecordRow(const uint64_t *obs, uint32_t obsNum)
+{
+  if (m_recorder) {
+    m_recorder->Record(m_socketUuid, obs, obsNum, m_new_ssThresh, m_new_cWnd, m_new_pacingRate);
+  }
+}
+
+void
+TcpGymEnv::RecordExchange()
+{
+  RecordRow(m_obs.data(), m_obs.size());
+}
+
+void
+TcpGymEnv::NotifyAgent()
+{
+  TcpRlProfiler::Scope scope (TcpRlProfiler::NOTIFY);
+  uint64_t start = TcpRlProfiler::GetWallTime();
+  if (m_localAgent) {
+    Ptr<OpenGymDataContainer> obs = GetObservation();
+    ExecuteActions(m_localAgent->GetAction(obs, GetReward(), GetGameOver()));
+  } else {
+    Notify();
+  }
+  if (PastDeadline(start, TcpRlProfiler::GetWallTime())) {
+    DropAction(true);
+  }
+  RecordExchange();
+}
+
+Ptr<OpenGymBoxContainer<uint64_t> >
+TcpGymEnv::SetObservationData(uint32_t rowNum)
+{
+  // the shape is fixed when the box is created, keep it while it fits
+  uint32_t size = m_obs.size();
+  if (!m_obsBox || m_obsBoxRowNum != rowNum || m_obsBoxSize != size) {
+    std::vector<uint32_t> shape = {size,};
+    if (rowNum) {
+      shape = {rowNum, size / rowNum,};
+    }
+    m_obsBox = CreateObject<OpenGymBoxContainer<uint64_t> >(shape);
+    m_obsBoxRowNum = rowNum;
+    m_obsBoxSize = size;
+  }
+  // not in place: ns3gym's box has no clear, and SetData takes a vector by
+  // value, so every observation allocates that argument and copies the
+  // values twice (into the argument and into the box's storage, which
+  // keeps its capacity). Only the box itself is reused.
+  m_obsBox->SetData(m_obs);
+  return m_obsBox;
+}
+
 std::string
 TcpGymEnv::GetTcpCongStateName(const TcpSocketState::TcpCongState_t state)
 { //hata ayıklama için TCP soket değerini string'e çevirme
@@ -126,11 +476,54 @@ TcpGymEnv::GetTcpCAEventName(const TcpSocketState::TcpCAEvent_t event)
 Ptr<OpenGymSpace>
 TcpGymEnv::GetActionSpace()
 {
-  uint32_t parameterNum = 2;
-  float low = 0.0;
-  float high = 65535;
-  std::vector<uint32_t> shape = {parameterNum,};
+  if (m_actionSpace) {
+    return m_actionSpace;
+  }
+  m_actionSpace = CreateActionSpace(0);
+  return m_actionSpace;
+}
+
+// action space bounds of an action mode, actions outside of them are dropped
+static void
+GetActionBounds(TcpGymEnv::ActionMode_t mode, double &low, double &high)
+{
+  // tcb->m_cWnd is 32 bit, windows up to 4 GiB
+  low = 0.0;
+  high = 4294967295.0;
+  if (mode == TcpGymEnv::ACTION_ADDITIVE) {
+    // segments
+    low = -1000.0;
+    high = 1000.0;
+  } else if (mode == TcpGymEnv::ACTION_MULTIPLICATIVE) {
+    high = 10.0;
+  } else if (mode == TcpGymEnv::ACTION_LOG2) {
+    high = 32.0;
+  }
+}
+
+static bool
+InBounds(double value, double low, double high)
+{
+  // NaN fails both comparisons
+  return value >= low && value <= high;
+}
+
+Ptr<OpenGymSpace>
+TcpGymEnv::CreateActionSpace(uint32_t rowNum)
+{
+  uint32_t parameterNum = GetActionRowSize(m_actionMode);
+  double low, high;
+  GetActionBounds(m_actionMode, low, high);
   std::string dtype = TypeNameGet<uint32_t> ();
+  if (m_actionMode == ACTION_ADDITIVE || m_actionMode == ACTION_MULTIPLICATIVE || m_actionMode == ACTION_LOG2) {
+    dtype = TypeNameGet<float> ();
+  } else if (m_actionMode == ACTION_SEGMENTS) {
+    dtype = TypeNameGet<uint64_t> ();
+  }
+  std::vector<uint32_t> shape = {parameterNum,};
+  if (rowNum) {
+    shape = {rowNum, parameterNum,};
+  }
 
   Ptr<OpenGymBoxSpace> box = CreateObject<OpenGymBoxSpace> (low, high, shape, dtype);
   NS_LOG_INFO ("MyGetActionSpace: " << box);
@@ -141,15 +534,12 @@ TcpGymEnv::GetActionSpace()
 bool
 TcpGymEnv::GetGameOver()
 {
-  m_isGameOver = false;
-  bool test = false;
-  static float stepCounter = 0.0;
-  stepCounter += 1;
-  if (stepCounter == 10 && test) {
-      m_isGameOver = true;
-  }
-  NS_LOG_INFO ("MyGetGameOver: " << m_isGameOver);
-  return m_isGameOver;
+  // game over through the OpenGymInterface ends the agent's whole episode and
+  // ns3gym stops the process on the next reset; those sockets end with the
+  // simulation instead, which stops once all of them are over
+  bool gameOver = m_isGameOver && m_localAgent;
+  NS_LOG_INFO ("MyGetGameOver: " << gameOver);
+  return gameOver;
 }
 
 //ödül fonksiyonunun tanımlanması
@@ -174,11 +564,89 @@ Execute received actions
 bool
 TcpGymEnv::ExecuteActions(Ptr<OpenGymDataContainer> action)
 {
-  Ptr<OpenGymBoxContainer<uint32_t> > box = DynamicCast<OpenGymBoxContainer<uint32_t> >(action);
-  m_new_ssThresh = box->GetValue(0);
-  m_new_cWnd = box->GetValue(1);
-
   NS_LOG_INFO ("MyExecuteActions: " << action);
+  return ExecuteActionRow(action, 0);
+}
+
+static uint32_t
+ClampWindow(double value, uint32_t min)
+{
+  return static_cast<uint32_t> (std::max<double> (min, std::min<double> (value, 4294967295.0)));
+}
+
+bool
+TcpGymEnv::ExecuteActionRow(Ptr<OpenGymDataContainer> action, uint32_t row)
+{
+  if (m_isGameOver) {
+    // answer to the last observation, the delegate keeps the window
+    return false;
+  }
+  uint32_t width = GetActionRowSize(m_actionMode);
+  double low, high;
+  GetActionBounds(m_actionMode, low, high);
+  if (m_actionMode == ACTION_ADDITIVE || m_actionMode == ACTION_MULTIPLICATIVE || m_actionMode == ACTION_LOG2) {
+    Ptr<OpenGymBoxContainer<float> > box = DynamicCast<OpenGymBoxContainer<float> >(action);
+    // local agents answer in absolute uint32 values in every mode, those are read below
+    if (box && m_tcb) {
+      double ssThresh = box->GetValue(width * row);
+      double cWnd = box->GetValue(width * row + 1);
+      if (!InBounds(ssThresh, low, high) || !InBounds(cWnd, low, high)) {
+        DropAction(false);
+        return false;
+      }
+      // relative to the window the socket has now
+      double segmentSize = m_tcb->m_segmentSize;
+      if (m_actionMode == ACTION_ADDITIVE) {
+        ssThresh = m_tcb->m_ssThresh + ssThresh * segmentSize;
+        cWnd = m_tcb->m_cWnd + cWnd * segmentSize;
+      } else if (m_actionMode == ACTION_MULTIPLICATIVE) {
+        ssThresh *= m_tcb->m_ssThresh;
+        cWnd *= m_tcb->m_cWnd;
+      } else {
+        ssThresh = std::exp2(ssThresh);
+        cWnd = std::exp2(cWnd);
+      }
+      m_new_ssThresh = ClampWindow(ssThresh, 2 * m_tcb->m_segmentSize);
+      m_new_cWnd = ClampWindow(cWnd, m_tcb->m_segmentSize);
+      m_agentAction = true;
+      return true;
+    }
+  }
+  if (m_actionMode == ACTION_SEGMENTS) {
+    Ptr<OpenGymBoxContainer<uint64_t> > segments = DynamicCast<OpenGymBoxContainer<uint64_t> >(action);
+    if (segments && m_tcb) {
+      uint64_t ssThresh = segments->GetValue(width * row);
+      uint64_t cWnd = segments->GetValue(width * row + 1);
+      if (!cWnd || ssThresh > high || cWnd > high) {
+        DropAction(false);
+        return false;
+      }
+      double segmentSize = m_tcb->m_segmentSize;
+      m_new_ssThresh = ClampWindow(ssThresh * segmentSize, 2 * m_tcb->m_segmentSize);
+      m_new_cWnd = ClampWindow(cWnd * segmentSize, m_tcb->m_segmentSize);
+      m_agentAction = true;
+      return true;
+    }
+  }
+
+  Ptr<OpenGymBoxContainer<uint32_t> > box = DynamicCast<OpenGymBoxContainer<uint32_t> >(action);
+  if (!box) {
+    return false;
+  }
+  uint32_t stride = GetActionStride(box->GetShape(), m_actionMode);
+  // every uint32 is in the action space, an empty window stalls the flow
+  if (!box->GetValue(stride * row + 1)) {
+    DropAction(false);
+    return false;
+  }
+  m_new_ssThresh = box->GetValue(stride * row);
+  m_new_cWnd = box->GetValue(stride * row + 1);
+  if (m_actionMode == ACTION_PACING) {
+    // kbit/s, a uint32 of bit/s would end at 4.29 Gbit/s; rows without a
+    // pacing rate leave pacing to the socket
+    m_new_pacingRate = stride > 2 ? static_cast<uint64_t> (box->GetValue(stride * row + 2)) * 1000 : 0;
+  }
+  m_agentAction = true;
   return true;
 }
 
@@ -227,12 +695,94 @@ TcpEventGymEnv::SetPenalty(float value)
   m_penalty = value;
 }
 
+void
+TcpEventGymEnv::SetNotifyMode(NotifyMode_t mode)
+{
+  NS_LOG_FUNCTION (this << mode);
+  m_notifyMode = mode;
+}
+
+void
+TcpEventGymEnv::SetNotifyAckNum(uint32_t value)
+{
+  NS_LOG_FUNCTION (this << value);
+  m_notifyAckNum = value;
+}
+
+void
+TcpEventGymEnv::SetNotifyThreshold(double value)
+{
+  NS_LOG_FUNCTION (this << value);
+  m_notifyThreshold = value;
+}
+
+bool
+TcpEventGymEnv::Moved(double value, double lastValue, double threshold)
+{
+  if (lastValue == 0) {
+    return value != 0;
+  }
+  return std::abs(value - lastValue) > threshold * lastValue;
+}
+
+bool
+TcpEventGymEnv::ShouldNotify()
+{
+  if (!m_notified) {
+    // no action yet
+    return true;
+  }
+
+  switch (m_notifyMode) {
+    case NOTIFY_EVERY_N_ACKS:
+      return m_ackNum >= m_notifyAckNum;
+    case NOTIFY_PER_RTT:
+      return Simulator::Now() - m_lastNotifyTime >= m_rtt;
+    case NOTIFY_ON_CHANGE:
+      return Moved(m_tcb->m_cWnd, m_lastNotifyCWnd, m_notifyThreshold)
+             || Moved(m_bytesInFlight, m_lastNotifyBytesInFlight, m_notifyThreshold)
+             || Moved(m_rtt.GetDouble(), m_lastNotifyRtt.GetDouble(), m_notifyThreshold);
+    default:
+      return true;
+  }
+}
+
+void
+TcpEventGymEnv::NotifyAggregated()
+{
+  if (m_isGameOver) {
+    // the last observation was sent
+    return;
+  }
+  UpdateGameOver(false, m_segmentsAcked, m_rtt);
+  if (m_rewardModel && m_rewardModel->IsEnabled()) {
+    // the first interval starts with the simulation
+    m_envReward = ComputeModelReward(Simulator::Now() - m_lastNotifyTime, m_segmentsAcked, m_lossNum,
+                                     m_rtt, m_lastNotifyRtt);
+  }
+  NotifyAgent();
+
+  m_notified = true;
+  m_lastNotifyTime = Simulator::Now();
+  m_lastNotifyCWnd = m_tcb->m_cWnd;
+  m_lastNotifyBytesInFlight = m_bytesInFlight;
+  m_lastNotifyRtt = m_rtt;
+
+  m_ackNum = 0;
+  m_segmentsAcked = 0;
+  m_lossNum = 0;
+  m_envReward = 0.0;
+}
+
 /*
 Define observation space
 */
 Ptr<OpenGymSpace>
 TcpEventGymEnv::GetObservationSpace()
 {
+  if (m_obsSpace) {
+    return m_obsSpace;
+  }
   // socket unique ID
   // tcp env type: event-based = 0 / time-based = 1
   // sim time in us
@@ -248,7 +798,7 @@ TcpEventGymEnv::GetObservationSpace()
   // congestion algorithm (CA) state
   // CA event
   // ECN state
-  uint32_t parameterNum = 10;
+  uint32_t parameterNum = GetObsParameterNum(m_featureSet);
   float low = 0.0;
   float high = 1000000000.0;
   std::vector<uint32_t> shape = {parameterNum,};
@@ -256,35 +806,88 @@ TcpEventGymEnv::GetObservationSpace()
 
   Ptr<OpenGymBoxSpace> box = CreateObject<OpenGymBoxSpace> (low, high, shape, dtype);
   NS_LOG_INFO ("MyGetObservationSpace: " << box);
+  m_obsSpace = box;
   return box;
 }
 
+void
+TcpEventGymEnv::SetFeatureSet(FeatureSet_t set)
+{
+  TcpGymEnv::SetFeatureSet(set);
+  switch (set) {
+    case FEATURES_MINIMAL:
+      m_fillFeatures = &TcpEventGymEnv::FillFeatures<FEATURES_MINIMAL>;
+      break;
+    case FEATURES_BASIC:
+      m_fillFeatures = &TcpEventGymEnv::FillFeatures<FEATURES_BASIC>;
+      break;
+    case FEATURES_FULL:
+      m_fillFeatures = &TcpEventGymEnv::FillFeatures<FEATURES_FULL>;
+      break;
+    case FEATURES_EXTENDED:
+      m_fillFeatures = &TcpEventGymEnv::FillFeatures<FEATURES_EXTENDED>;
+      break;
+  }
+}
+
+uint32_t
+TcpEventGymEnv::GetObsParameterNum(FeatureSet_t set)
+{
+  switch (set) {
+    case FEATURES_MINIMAL:
+      return 9;
+    case FEATURES_BASIC:
+    case FEATURES_FULL:
+      return 10;
+    default:
+      return 15;
+  }
+}
+
+uint32_t
+TcpEventGymEnv::GetObsRowSize() const
+{
+  return GetObsParameterNum(m_featureSet);
+}
+
+// S is a constant in every instantiation, the compiler drops the skipped features
+template <TcpGymEnv::FeatureSet_t S>
+void
+TcpEventGymEnv::FillFeatures()
+{
+  m_obs.clear();
+  m_obs.push_back(m_socketUuid);
+  m_obs.push_back(0);
+  m_obs.push_back(Simulator::Now().GetMicroSeconds ());
+  m_obs.push_back(m_nodeId);
+  m_obs.push_back(m_tcb->m_ssThresh);
+  m_obs.push_back(m_tcb->m_cWnd);
+  m_obs.push_back(m_tcb->m_segmentSize);
+  m_obs.push_back(m_segmentsAcked);
+  m_obs.push_back(m_bytesInFlight);
+  if (S < FEATURES_BASIC) {
+    return;
+  }
+  m_obs.push_back(m_rtt.GetMicroSeconds ());
+  if (S < FEATURES_EXTENDED) {
+    return;
+  }
+  m_obs.push_back(m_tcb->m_minRtt.GetMicroSeconds ());
+  m_obs.push_back(m_calledFunc);
+  m_obs.push_back(m_tcb->m_congState);
+  m_obs.push_back(m_event);
+  m_obs.push_back(m_tcb->m_ecnState);
+}
+
 /*
 Collect observations
 */
 Ptr<OpenGymDataContainer>
 TcpEventGymEnv::GetObservation()
 {
-  uint32_t parameterNum = 10;
-  std::vector<uint32_t> shape = {parameterNum,};
+  (this->*m_fillFeatures)();
 
-  Ptr<OpenGymBoxContainer<uint64_t> > box = CreateObject<OpenGymBoxContainer<uint64_t> >(shape);
-
-  box->AddValue(m_socketUuid);
-  box->AddValue(0);
-  box->AddValue(Simulator::Now().GetMicroSeconds ());
-  box->AddValue(m_nodeId);
-  box->AddValue(m_tcb->m_ssThresh);
-  box->AddValue(m_tcb->m_cWnd);
-  box->AddValue(m_tcb->m_segmentSize);
-  box->AddValue(m_segmentsAcked);
-  box->AddValue(m_bytesInFlight);
-  box->AddValue(m_rtt.GetMicroSeconds ());
-  //box->AddValue(m_tcb->m_minRtt.GetMicroSeconds ());
-  //box->AddValue(m_calledFunc);
-  //box->AddValue(m_tcb->m_congState);
-  //box->AddValue(m_event);
-  //box->AddValue(m_tcb->m_ecnState);
+  Ptr<OpenGymBoxContainer<uint64_t> > box = SetObservationData(0);
 
   // Print data
   NS_LOG_INFO ("MyGetObservation: " << box);
@@ -307,15 +910,17 @@ uint32_t
 TcpEventGymEnv::GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight)
 {
   NS_LOG_FUNCTION (this);
-  // pkt was lost, so penalty
-  m_envReward = m_penalty;
+  // pkt was lost, so penalty (on top of the rewards of the aggregated ACKs)
+  m_envReward += m_penalty;
+  m_lossNum++;
+  Register();
 
   NS_LOG_INFO(Simulator::Now() << " Node: " << m_nodeId << " GetSsThresh, BytesInFlight: " << bytesInFlight);
   m_calledFunc = CalledFunc_t::GET_SS_THRESH;
   m_info = "GetSsThresh";
   m_tcb = tcb;
   m_bytesInFlight = bytesInFlight;
-  Notify();
+  NotifyAggregated();
   return m_new_ssThresh;
 }
 
@@ -324,15 +929,22 @@ TcpEventGymEnv::IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked)
 {
   NS_LOG_FUNCTION (this);
   // pkt was acked, so reward
-  m_envReward = m_reward;
+  m_envReward += m_reward;
+  Register();
 
   NS_LOG_INFO(Simulator::Now() << " Node: " << m_nodeId << " IncreaseWindow, SegmentsAcked: " << segmentsAcked);
   m_calledFunc = CalledFunc_t::INCREASE_WINDOW;
   m_info = "IncreaseWindow";
   m_tcb = tcb;
-  m_segmentsAcked = segmentsAcked;
-  Notify();
-  tcb->m_cWnd = m_new_cWnd;
+  m_bytesInFlight = tcb->m_bytesInFlight;
+  m_ackNum++;
+  if (ShouldNotify()) {
+    NotifyAggregated();
+  }
+  if (m_agentAction) {
+    tcb->m_cWnd = m_new_cWnd;
+    ApplyPacing(tcb);
+  }
 }
 
 void
@@ -343,7 +955,8 @@ TcpEventGymEnv::PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, cons
   m_calledFunc = CalledFunc_t::PKTS_ACKED;
   m_info = "PktsAcked";
   m_tcb = tcb;
-  m_segmentsAcked = segmentsAcked;
+  // summed up until the next notification
+  m_segmentsAcked += segmentsAcked;
   m_rtt = rtt;
 }
 
@@ -361,37 +974,288 @@ TcpEventGymEnv::CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketStat
 }
 
 void
-TcpEventGymEnv::CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event)
+TcpEventGymEnv::CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event)
+{
+  NS_LOG_FUNCTION (this);
+  std::string eventName = GetTcpCAEventName(event);
+  NS_LOG_INFO(Simulator::Now() << " Node: " << m_nodeId << " CwndEvent: " << event << " " << eventName);
+
+  m_calledFunc = CalledFunc_t::CWND_EVENT;
+  m_info = "CwndEvent";
+  m_tcb = tcb;
+  m_event = event;
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (TcpTimeStepGymEnv);
+
+const uint32_t TcpTimeStepGymEnv::m_obsParameterNum;
+const uint32_t TcpTimeStepGymEnv::m_obsParameterMax;
+
+TcpTimeStepGymEnv::TcpTimeStepGymEnv () : TcpGymEnv()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+TcpTimeStepGymEnv::ScheduleNextStateRead ()
+{
+  NS_LOG_FUNCTION (this);
+  bool gameOver = CheckGameOver();
+  if (!gameOver) {
+    Simulator::Schedule (m_timeStep, &TcpTimeStepGymEnv::ScheduleNextStateRead, this);
+  }
+  if (m_async) {
+    // the last step is answered before the simulation ends, Duration 0 has none
+    NotifyAgentAsync(gameOver || (m_duration.IsStrictlyPositive() && Simulator::Now() + m_timeStep >= m_duration));
+    return;
+  }
+  NotifyAgent();
+}
+
+bool
+TcpTimeStepGymEnv::CheckGameOver()
+{
+  // the duration ends with the last step that fits into it
+  bool end = m_duration.IsStrictlyPositive() && Simulator::Now() + m_timeStep >= m_duration;
+  return UpdateGameOver(end, m_segmentsAcked.GetSum(), GetAvgRtt());
+}
+
+void
+TcpTimeStepGymEnv::Start ()
+{
+  NS_LOG_FUNCTION (this);
+  m_started = true;
+  Register();
+  if (m_batched || m_localAgent) {
+    // the batched exchange and local agents stay synchronous
+    m_async = false;
+  }
+  if (m_batched) {
+    // no action for this socket until the next shared step, the delegate keeps the window
+    m_new_ssThresh = m_tcb->m_ssThresh;
+    m_new_cWnd = m_tcb->m_cWnd;
+    TcpTimeStepBatchGymEnv::Get (m_timeStep, m_batchSize)->AddSocketEnv (this);
+    return;
+  }
+  if (m_async) {
+    // there is no previous action yet, wait for the first one
+    NotifyAgentAsync(true);
+  } else {
+    NotifyAgent();
+  }
+  ScheduleNextStateRead();
+}
+
+/*
+Pipelined exchanges go through one worker thread with its own ZMQ
+connection to the agent port, the agent's REP socket answers it like the
+OpenGymInterface. Every ns-3 and ns3-gym call stays on the simulator
+thread: the worker only sends requests serialized there and keeps the raw
+replies, one exchange at a time in submission order. Stopped when the
+simulation is destroyed, after the queued exchanges are answered.
+*/
+class TcpRlAgentWorker
+{
+public:
+  static TcpRlAgentWorker *Get (uint32_t port);
+  static bool IsRunning ();
+  static void Delete ();
+
+  void Submit (TcpRlAgentExchange *exchange);
+  void Wait (TcpRlAgentExchange *exchange);
+
+private:
+  explicit TcpRlAgentWorker (uint32_t port);
+  ~TcpRlAgentWorker ();
+  void Run ();
+
+  static TcpRlAgentWorker *m_worker;
+
+  uint32_t m_port;
+  bool m_closing {false};
+  std::deque<TcpRlAgentExchange *> m_queue;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_thread;
+};
+
+TcpRlAgentWorker *TcpRlAgentWorker::m_worker = nullptr;
+
+TcpRlAgentWorker *
+TcpRlAgentWorker::Get (uint32_t port)
+{
+  if (!m_worker) {
+    m_worker = new TcpRlAgentWorker (port);
+    Simulator::ScheduleDestroy (&TcpRlAgentWorker::Delete);
+  }
+  NS_ABORT_MSG_UNLESS (m_worker->m_port == port, "Pipelined sockets have to use the same agent port");
+  return m_worker;
+}
+
+bool
+TcpRlAgentWorker::IsRunning ()
+{
+  return m_worker;
+}
+
+void
+TcpRlAgentWorker::Delete ()
+{
+  delete m_worker;
+  m_worker = nullptr;
+}
+
+TcpRlAgentWorker::TcpRlAgentWorker (uint32_t port)
+  : m_port (port)
+{
+  m_thread = std::thread (&TcpRlAgentWorker::Run, this);
+}
+
+TcpRlAgentWorker::~TcpRlAgentWorker ()
+{
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_closing = true;
+  }
+  m_cv.notify_all ();
+  m_thread.join ();
+}
+
+void
+TcpRlAgentWorker::Submit (TcpRlAgentExchange *exchange)
+{
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    exchange->done = false;
+    m_queue.push_back (exchange);
+  }
+  m_cv.notify_all ();
+}
+
+void
+TcpRlAgentWorker::Wait (TcpRlAgentExchange *exchange)
+{
+  std::unique_lock<std::mutex> lock (m_mutex);
+  m_cv.wait (lock, [exchange] { return exchange->done.load (); });
+}
+
+void
+TcpRlAgentWorker::Run ()
+{
+  // the socket lives on this thread only
+  zmq::context_t context (1);
+  zmq::socket_t socket (context, ZMQ_REQ);
+  socket.connect ("tcp://localhost:" + std::to_string (m_port));
+
+  std::unique_lock<std::mutex> lock (m_mutex);
+  while (true) {
+    m_cv.wait (lock, [this] { return !m_queue.empty () || m_closing; });
+    if (m_queue.empty ()) {
+      break;
+    }
+    TcpRlAgentExchange *exchange = m_queue.front ();
+    m_queue.pop_front ();
+    // the simulator does not touch a submitted exchange until it is done
+    lock.unlock ();
+    exchange->start = TcpRlProfiler::GetWallTime ();
+    zmq::message_t request (exchange->request.data (), exchange->request.size ());
+    socket.send (request);
+    zmq::message_t reply;
+    socket.recv (&reply);
+    exchange->reply.assign (static_cast<const char *> (reply.data ()), reply.size ());
+    exchange->end = TcpRlProfiler::GetWallTime ();
+    lock.lock ();
+    exchange->done = true;
+    m_cv.notify_all ();
+  }
+  socket.setsockopt (ZMQ_LINGER, 0);
+}
+
+void
+TcpTimeStepGymEnv::NotifyAgentAsync (bool wait)
 {
-  NS_LOG_FUNCTION (this);
-  std::string eventName = GetTcpCAEventName(event);
-  NS_LOG_INFO(Simulator::Now() << " Node: " << m_nodeId << " CwndEvent: " << event << " " << eventName);
-
-  m_calledFunc = CalledFunc_t::CWND_EVENT;
-  m_info = "CwndEvent";
-  m_tcb = tcb;
-  m_event = event;
+  NS_LOG_FUNCTION (this << wait);
+  if (!wait && m_actionDeadline.IsStrictlyPositive() && !m_exchange.done) {
+    // the agent is still on an earlier step, this step is aggregated into the next one
+    DropAction(true);
+    return;
+  }
+  FinishExchange();
+  ApplyPendingAction();
+
+  // the agent's callbacks only see this snapshot
+  m_obsSnapshot = BuildObservation();
+  m_gameOverSnapshot = TcpGymEnv::GetGameOver();
+  if (!TcpRlAgentWorker::IsRunning()) {
+    // the first exchange sends the spaces, it goes through the OpenGymInterface
+    uint64_t start = TcpRlProfiler::GetWallTime();
+    {
+      TcpRlProfiler::Scope scope (TcpRlProfiler::NOTIFY);
+      Notify();
+    }
+    m_exchangeLate = PastDeadline(start, TcpRlProfiler::GetWallTime());
+    TcpRlAgentWorker::Get(m_agentPort);
+    ApplyPendingAction();
+    return;
+  }
+  SubmitExchange();
+  if (wait) {
+    FinishExchange();
+    ApplyPendingAction();
+  }
 }
 
-
-NS_OBJECT_ENSURE_REGISTERED (TcpTimeStepGymEnv);
-
-TcpTimeStepGymEnv::TcpTimeStepGymEnv () : TcpGymEnv()
+void
+TcpTimeStepGymEnv::SubmitExchange ()
 {
-  NS_LOG_FUNCTION (this);
+  // what OpenGymInterface::NotifyCurrentState sends
+  ns3opengym::EnvStateMsg envStateMsg;
+  if (m_obsSnapshot) {
+    envStateMsg.mutable_obsdata()->CopyFrom(m_obsSnapshot->GetDataContainerPbMsg());
+  }
+  envStateMsg.set_reward(GetReward());
+  envStateMsg.set_isgameover(m_gameOverSnapshot);
+  if (m_gameOverSnapshot) {
+    envStateMsg.set_reason(ns3opengym::EnvStateMsg::GameOver);
+  }
+  envStateMsg.set_info(GetExtraInfo());
+  envStateMsg.SerializeToString(&m_exchange.request);
+  TcpRlAgentWorker::Get(m_agentPort)->Submit(&m_exchange);
+  m_exchangePending = true;
 }
 
 void
-TcpTimeStepGymEnv::ScheduleNextStateRead ()
+TcpTimeStepGymEnv::FinishExchange ()
 {
-  NS_LOG_FUNCTION (this);
-  Simulator::Schedule (m_timeStep, &TcpTimeStepGymEnv::ScheduleNextStateRead, this);
-  Notify();
+  if (!m_exchangePending) {
+    return;
+  }
+  {
+    TcpRlProfiler::Scope scope (TcpRlProfiler::NOTIFY);
+    TcpRlAgentWorker::Get(m_agentPort)->Wait(&m_exchange);
+  }
+  m_exchangePending = false;
+  m_exchangeLate = PastDeadline(m_exchange.start, m_exchange.end);
+
+  ns3opengym::EnvActMsg envActMsg;
+  envActMsg.ParseFromString(m_exchange.reply);
+  if (envActMsg.stopsimreq()) {
+    NS_LOG_INFO ("Agent requested the simulation to stop");
+    Simulator::Stop();
+    return;
+  }
+  ns3opengym::DataContainer actDataContainerPbMsg = envActMsg.actdata();
+  m_pendingAction = OpenGymDataContainer::CreateFromDataContainerPbMsg(actDataContainerPbMsg);
 }
 
 TcpTimeStepGymEnv::~TcpTimeStepGymEnv ()
 {
   NS_LOG_FUNCTION (this);
+  // the worker still holds a pointer to the exchange, it is drained before it stops
+  if (!m_exchange.done) {
+    TcpRlAgentWorker::Get(m_agentPort)->Wait(&m_exchange);
+  }
 }
 
 TypeId
@@ -410,6 +1274,13 @@ void
 TcpTimeStepGymEnv::DoDispose ()
 {
   NS_LOG_FUNCTION (this);
+  if (!m_exchange.done) {
+    // the answer comes too late for the simulation
+    TcpRlAgentWorker::Get(m_agentPort)->Wait(&m_exchange);
+  }
+  m_exchangePending = false;
+  m_obsSnapshot = 0;
+  m_pendingAction = 0;
 }
 
 void
@@ -440,12 +1311,50 @@ TcpTimeStepGymEnv::SetPenalty(float value)
   m_penalty = value;
 }
 
+void
+TcpTimeStepGymEnv::SetBatched(bool value)
+{
+  NS_LOG_FUNCTION (this);
+  m_batched = value;
+}
+
+void
+TcpTimeStepGymEnv::SetBatchSize(uint32_t value)
+{
+  NS_LOG_FUNCTION (this);
+  m_batchSize = value;
+}
+
+void
+TcpTimeStepGymEnv::SetAsync(bool value)
+{
+  NS_LOG_FUNCTION (this);
+  m_async = value;
+}
+
+void
+TcpTimeStepGymEnv::SetAgentPort(uint32_t value)
+{
+  NS_LOG_FUNCTION (this);
+  m_agentPort = value;
+}
+
+void
+TcpTimeStepGymEnv::SetObserveOnly(bool value)
+{
+  NS_LOG_FUNCTION (this);
+  m_observeOnly = value;
+}
+
 /*
 Define observation space
 */
 Ptr<OpenGymSpace>
 TcpTimeStepGymEnv::GetObservationSpace()
 {
+  if (m_obsSpace) {
+    return m_obsSpace;
+  }
   // socket unique ID
   // tcp env type: event-based = 0 / time-based = 1
   // sim time in us
@@ -457,12 +1366,24 @@ TcpTimeStepGymEnv::GetObservationSpace()
   // bytesInFlightAvg
   // segmentsAckedSum
   // segmentsAckedAvg
+  // FEATURES_BASIC:
   // avgRtt
   // minRtt
   // avgInterTx
   // avgInterRx
   // throughput
-  uint32_t parameterNum = 16;
+  // FEATURES_FULL:
+  // action latency in steps: 0 synchronous / 1 pipelined
+  // p50Rtt
+  // p95Rtt
+  // p99Rtt
+  // rttVariance
+  // maxRtt
+  // FEATURES_EXTENDED:
+  // congestion algorithm (CA) state
+  // CA event
+  // ECN state
+  uint32_t parameterNum = GetObsParameterNum(m_featureSet);
   float low = 0.0;
   float high = 1000000000.0;
   std::vector<uint32_t> shape = {parameterNum,};
@@ -470,6 +1391,7 @@ TcpTimeStepGymEnv::GetObservationSpace()
 
   Ptr<OpenGymBoxSpace> box = CreateObject<OpenGymBoxSpace> (low, high, shape, dtype);
   NS_LOG_INFO ("MyGetObservationSpace: " << box);
+  m_obsSpace = box;
   return box;
 }
 
@@ -479,68 +1401,185 @@ Collect observations
 Ptr<OpenGymDataContainer>
 TcpTimeStepGymEnv::GetObservation()
 {
-  uint32_t parameterNum = 16;
-  std::vector<uint32_t> shape = {parameterNum,};
+  if (m_async) {
+    return m_obsSnapshot;
+  }
+  return BuildObservation();
+}
+
+bool
+TcpTimeStepGymEnv::GetGameOver()
+{
+  if (m_async) {
+    // the game over that was sent with the observation
+    return m_gameOverSnapshot;
+  }
+  return TcpGymEnv::GetGameOver();
+}
+
+Ptr<OpenGymDataContainer>
+TcpTimeStepGymEnv::BuildObservation()
+{
+  m_obs.clear();
+  FillObservation(m_obs);
+  Ptr<OpenGymBoxContainer<uint64_t> > box = SetObservationData(0);
 
-  Ptr<OpenGymBoxContainer<uint64_t> > box = CreateObject<OpenGymBoxContainer<uint64_t> >(shape);
+  // Print data
+  NS_LOG_INFO ("MyGetObservation: " << box);
+  return box;
+}
 
-  box->AddValue(m_socketUuid);
-  box->AddValue(1);
-  box->AddValue(Simulator::Now().GetMicroSeconds ());
-  box->AddValue(m_nodeId);
-  box->AddValue(m_tcb->m_ssThresh);
-  box->AddValue(m_tcb->m_cWnd);
-  box->AddValue(m_tcb->m_segmentSize);
+// S is a constant in every instantiation, the compiler drops the skipped features
+template <TcpGymEnv::FeatureSet_t S>
+void
+TcpTimeStepGymEnv::FillFeatures(std::vector<uint64_t> &obs)
+{
+  obs.push_back(m_socketUuid);
+  obs.push_back(1);
+  obs.push_back(Simulator::Now().GetMicroSeconds ());
+  obs.push_back(m_nodeId);
+  obs.push_back(m_tcb->m_ssThresh);
+  obs.push_back(m_tcb->m_cWnd);
+  obs.push_back(m_tcb->m_segmentSize);
 
   //bytesInFlightSum
-  uint64_t bytesInFlightSum = std::accumulate(m_bytesInFlight.begin(), m_bytesInFlight.end(), 0);
-  box->AddValue(bytesInFlightSum);
+  uint64_t bytesInFlightSum = m_bytesInFlight.GetSum();
+  obs.push_back(bytesInFlightSum);
 
   //bytesInFlightAvg
   uint64_t bytesInFlightAvg = 0;
-  if (m_bytesInFlight.size()) {
-    bytesInFlightAvg = bytesInFlightSum / m_bytesInFlight.size();
+  if (m_bytesInFlight.GetCount()) {
+    bytesInFlightAvg = bytesInFlightSum / m_bytesInFlight.GetCount();
   }
-  box->AddValue(bytesInFlightAvg);
+  obs.push_back(bytesInFlightAvg);
 
   //segmentsAckedSum
-  uint64_t segmentsAckedSum = std::accumulate(m_segmentsAcked.begin(), m_segmentsAcked.end(), 0);
-  box->AddValue(segmentsAckedSum);
+  uint64_t segmentsAckedSum = m_segmentsAcked.GetSum();
+  obs.push_back(segmentsAckedSum);
 
   //segmentsAckedAvg
   uint64_t segmentsAckedAvg = 0;
-  if (m_segmentsAcked.size()) {
-    segmentsAckedAvg = segmentsAckedSum / m_segmentsAcked.size();
+  if (m_segmentsAcked.GetCount()) {
+    segmentsAckedAvg = segmentsAckedSum / m_segmentsAcked.GetCount();
   }
-  box->AddValue(segmentsAckedAvg);
+  obs.push_back(segmentsAckedAvg);
 
-  //avgRtt
-  Time avgRtt = Seconds(0.0);
-  if(m_rttSampleNum) {
-    avgRtt = m_rttSum / m_rttSampleNum;
+  if (S < FEATURES_BASIC) {
+    return;
   }
-  box->AddValue(avgRtt.GetMicroSeconds ());
+
+  //avgRtt
+  obs.push_back(GetAvgRtt().GetMicroSeconds ());
 
   //m_minRtt
-  box->AddValue(m_tcb->m_minRtt.GetMicroSeconds ());
+  obs.push_back(m_tcb->m_minRtt.GetMicroSeconds ());
 
   //avgInterTx
   Time avgInterTx = Seconds(0.0);
   if (m_interTxTimeNum) {
     avgInterTx = m_interTxTimeSum / m_interTxTimeNum;
   }
-  box->AddValue(avgInterTx.GetMicroSeconds ());
+  obs.push_back(avgInterTx.GetMicroSeconds ());
 
   //avgInterRx
   Time avgInterRx = Seconds(0.0);
   if (m_interRxTimeNum) {
     avgInterRx = m_interRxTimeSum / m_interRxTimeNum;
   }
-  box->AddValue(avgInterRx.GetMicroSeconds ());
+  obs.push_back(avgInterRx.GetMicroSeconds ());
 
   //throughput  bytes/s
   float throughput = (segmentsAckedSum * m_tcb->m_segmentSize) / m_timeStep.GetSeconds();
-  box->AddValue(throughput);
+  obs.push_back(throughput);
+
+  if (S < FEATURES_FULL) {
+    return;
+  }
+
+  //action latency in steps
+  obs.push_back(m_async ? 1 : 0);
+
+  //p50Rtt, p95Rtt, p99Rtt
+  obs.push_back(m_rttHistogram.GetPercentile(0.50));
+  obs.push_back(m_rttHistogram.GetPercentile(0.95));
+  obs.push_back(m_rttHistogram.GetPercentile(0.99));
+
+  //rttVariance us^2
+  obs.push_back(m_rtt.GetVariance() / 1e6);
+
+  //maxRtt
+  obs.push_back(m_rtt.GetMax() / 1000);
+
+  if (S < FEATURES_EXTENDED) {
+    return;
+  }
+
+  //congState, last CA event, ecnState
+  obs.push_back(m_tcb->m_congState);
+  obs.push_back(m_event);
+  obs.push_back(m_tcb->m_ecnState);
+}
+
+void
+TcpTimeStepGymEnv::SetFeatureSet(FeatureSet_t set)
+{
+  TcpGymEnv::SetFeatureSet(set);
+  switch (set) {
+    case FEATURES_MINIMAL:
+      m_fillFeatures = &TcpTimeStepGymEnv::FillFeatures<FEATURES_MINIMAL>;
+      break;
+    case FEATURES_BASIC:
+      m_fillFeatures = &TcpTimeStepGymEnv::FillFeatures<FEATURES_BASIC>;
+      break;
+    case FEATURES_FULL:
+      m_fillFeatures = &TcpTimeStepGymEnv::FillFeatures<FEATURES_FULL>;
+      break;
+    case FEATURES_EXTENDED:
+      m_fillFeatures = &TcpTimeStepGymEnv::FillFeatures<FEATURES_EXTENDED>;
+      break;
+  }
+}
+
+uint32_t
+TcpTimeStepGymEnv::GetObsParameterNum(FeatureSet_t set)
+{
+  switch (set) {
+    case FEATURES_MINIMAL:
+      return 11;
+    case FEATURES_BASIC:
+      return 16;
+    case FEATURES_FULL:
+      return m_obsParameterNum;
+    default:
+      return m_obsParameterMax;
+  }
+}
+
+uint32_t
+TcpTimeStepGymEnv::GetObsRowSize() const
+{
+  return GetObsParameterNum(m_featureSet);
+}
+
+Time
+TcpTimeStepGymEnv::GetAvgRtt() const
+{
+  if (!m_rtt.GetCount()) {
+    return Seconds(0.0);
+  }
+  return NanoSeconds(m_rtt.GetSum() / m_rtt.GetCount());
+}
+
+void
+TcpTimeStepGymEnv::FillObservation(std::vector<uint64_t> &obs)
+{
+  if (m_observeOnly) {
+    // the window the controller chose during this step is the action
+    m_new_ssThresh = m_tcb->m_ssThresh;
+    m_new_cWnd = m_tcb->m_cWnd;
+  }
+  (this->*m_fillFeatures)(obs);
+  Time avgRtt = GetAvgRtt();
 
 /*---------------------------------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------------------------------*/
@@ -574,28 +1613,50 @@ TcpTimeStepGymEnv::GetObservation()
 /*---------------------------------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------------------------------*/
 
-  // Print data
-  NS_LOG_INFO ("MyGetObservation: " << box);
+  if (m_rewardModel && m_rewardModel->IsEnabled()) {
+    // replaces the reward above, computed from the stats of the step
+    m_envReward = ComputeModelReward(m_timeStep, m_segmentsAcked.GetSum(), m_lossNum, avgRtt, m_prevAvgRtt);
+  }
+  if (avgRtt.IsStrictlyPositive()) {
+    m_prevAvgRtt = avgRtt;
+  }
 
-  m_bytesInFlight.clear();
-  m_segmentsAcked.clear();
+  m_bytesInFlight.Reset();
+  m_segmentsAcked.Reset();
+  m_lossNum = 0;
 
-  m_rttSampleNum = 0;
-  m_rttSum = MicroSeconds (0.0);
+  m_rtt.Reset();
+  m_rttHistogram.Reset();
 
   m_interTxTimeNum = 0;
   m_interTxTimeSum = MicroSeconds (0.0);
 
   m_interRxTimeNum = 0;
   m_interRxTimeSum = MicroSeconds (0.0);
-  
-  return box;
+}
+
+/*
+Execute Actions
+*/
+bool
+TcpTimeStepGymEnv::ExecuteActions(Ptr<OpenGymDataContainer> action)
+{
+  if (m_async) {
+    // picked up by the simulation at the next step boundary
+    m_pendingAction = action;
+    return true;
+  }
+  return TcpGymEnv::ExecuteActions(action);
 }
 
 void
 TcpTimeStepGymEnv::TxPktTrace(Ptr<const Packet>, const TcpHeader&, Ptr<const TcpSocketBase>)
 {
   NS_LOG_FUNCTION (this);
+  if (m_featureSet < FEATURES_BASIC) {
+    // inter packet times are not sent
+    return;
+  }
   if ( m_lastPktTxTime > MicroSeconds(0.0) ) {
     Time interTxTime = Simulator::Now() - m_lastPktTxTime;
     m_interTxTimeSum += interTxTime;
@@ -609,6 +1670,10 @@ void
 TcpTimeStepGymEnv::RxPktTrace(Ptr<const Packet>, const TcpHeader&, Ptr<const TcpSocketBase>)
 {
   NS_LOG_FUNCTION (this);
+  if (m_featureSet < FEATURES_BASIC) {
+    // inter packet times are not sent
+    return;
+  }
   if ( m_lastPktRxTime > MicroSeconds(0.0) ) {
     Time interRxTime = Simulator::Now() - m_lastPktRxTime;
     m_interRxTimeSum +=  interRxTime;
@@ -624,12 +1689,11 @@ TcpTimeStepGymEnv::GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInF
   NS_LOG_FUNCTION (this);
   NS_LOG_INFO(Simulator::Now() << " Node: " << m_nodeId << " GetSsThresh, BytesInFlight: " << bytesInFlight);
   m_tcb = tcb;
-  m_bytesInFlight.push_back(bytesInFlight);
+  m_bytesInFlight.Add(bytesInFlight);
+  m_lossNum++;
 
   if (!m_started) {
-    m_started = true;
-    Notify();
-    ScheduleNextStateRead();
+    Start();
   }
 
   // action
@@ -642,16 +1706,17 @@ TcpTimeStepGymEnv::IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAck
   NS_LOG_FUNCTION (this);
   NS_LOG_INFO(Simulator::Now() << " Node: " << m_nodeId << " IncreaseWindow, SegmentsAcked: " << segmentsAcked);
   m_tcb = tcb;
-  m_segmentsAcked.push_back(segmentsAcked);
-  m_bytesInFlight.push_back(tcb->m_bytesInFlight);
+  m_segmentsAcked.Add(segmentsAcked);
+  m_bytesInFlight.Add(tcb->m_bytesInFlight);
 
   if (!m_started) {
-    m_started = true;
-    Notify();
-    ScheduleNextStateRead();
+    Start();
   }
   // action
-  tcb->m_cWnd = m_new_cWnd;
+  if (!m_observeOnly && m_agentAction) {
+    tcb->m_cWnd = m_new_cWnd;
+    ApplyPacing(tcb);
+  }
 }
 
 void
@@ -660,8 +1725,10 @@ TcpTimeStepGymEnv::PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, c
   NS_LOG_FUNCTION (this);
   NS_LOG_INFO(Simulator::Now() << " Node: " << m_nodeId << " PktsAcked, SegmentsAcked: " << segmentsAcked << " Rtt: " << rtt);
   m_tcb = tcb;
-  m_rttSum += rtt;
-  m_rttSampleNum++;
+  m_rtt.Add(rtt.GetNanoSeconds ());
+  if (m_featureSet >= FEATURES_FULL) {
+    m_rttHistogram.Add(rtt.GetMicroSeconds ());
+  }
 }
 
 void
@@ -679,6 +1746,258 @@ TcpTimeStepGymEnv::CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::Tcp
   NS_LOG_FUNCTION (this);
   std::string eventName = GetTcpCAEventName(event);
   NS_LOG_INFO(Simulator::Now() << " Node: " << m_nodeId << " CwndEvent: " << event << " " << eventName);
+  m_event = event;
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (TcpTimeStepBatchGymEnv);
+
+TcpTimeStepBatchGymEnv::TcpTimeStepBatchGymEnv () : TcpGymEnv()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpTimeStepBatchGymEnv::~TcpTimeStepBatchGymEnv ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TypeId
+TcpTimeStepBatchGymEnv::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpTimeStepBatchGymEnv")
+    .SetParent<TcpGymEnv> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpTimeStepBatchGymEnv> ()
+  ;
+
+  return tid;
+}
+
+void
+TcpTimeStepBatchGymEnv::DoDispose ()
+{
+  NS_LOG_FUNCTION (this);
+  m_envs.clear();
+}
+
+Ptr<TcpTimeStepBatchGymEnv> *
+TcpTimeStepBatchGymEnv::DoGet (void)
+{
+  static Ptr<TcpTimeStepBatchGymEnv> ptr = 0;
+  return &ptr;
+}
+
+void
+TcpTimeStepBatchGymEnv::Delete (void)
+{
+  Ptr<TcpTimeStepBatchGymEnv> *ptr = DoGet ();
+  if (*ptr) {
+    (*ptr)->Dispose ();
+  }
+  *ptr = 0;
+}
+
+Ptr<TcpTimeStepBatchGymEnv>
+TcpTimeStepBatchGymEnv::Get (Time timeStep, uint32_t socketNum)
+{
+  Ptr<TcpTimeStepBatchGymEnv> *ptr = DoGet ();
+  if (!*ptr) {
+    *ptr = CreateObject<TcpTimeStepBatchGymEnv> ();
+    (*ptr)->m_timeStep = timeStep;
+    (*ptr)->m_socketNum = socketNum;
+    Simulator::ScheduleDestroy (&TcpTimeStepBatchGymEnv::Delete);
+  }
+  NS_ASSERT_MSG ((*ptr)->m_timeStep == timeStep, "All batched sockets have to use the same StepTime.");
+  NS_ASSERT_MSG ((*ptr)->m_socketNum == socketNum, "All batched sockets have to use the same BatchSize.");
+  return *ptr;
+}
+
+void
+TcpTimeStepBatchGymEnv::AddSocketEnv(Ptr<TcpTimeStepGymEnv> env)
+{
+  NS_LOG_FUNCTION (this << env);
+  NS_ASSERT_MSG (m_envs.empty() || env->GetFeatureSet() == m_featureSet, "Batched sockets need the same FeatureSet");
+  NS_ASSERT_MSG (m_envs.empty() || env->GetActionMode() == m_actionMode, "Batched sockets need the same ActionMode");
+  NS_ABORT_MSG_UNLESS (m_envs.empty() || env->GetLocalAgent() == m_localAgent,
+                       "Batched sockets need the same local agent (or none)");
+  NS_ABORT_MSG_UNLESS (m_envs.size() < m_socketNum, "More batched sockets than BatchSize (" << m_socketNum << ")");
+  m_envs.push_back(env);
+
+  if (!m_started) {
+    // rows are only stacked if they have the same features and actions
+    m_featureSet = env->GetFeatureSet();
+    m_actionMode = env->GetActionMode();
+    m_actionDeadline = env->GetActionDeadline();
+    // the whole matrix goes through one GetAction of the shared agent,
+    // without one the batch is exchanged over ZMQ
+    m_localAgent = env->GetLocalAgent();
+    // align the shared step clock to a multiple of the step time
+    m_started = true;
+    Time now = Simulator::Now ();
+    Time next = m_timeStep * (now.GetInteger () / m_timeStep.GetInteger () + 1);
+    Simulator::Schedule (next - now, &TcpTimeStepBatchGymEnv::ScheduleNextStateRead, this);
+  }
+}
+
+void
+TcpTimeStepBatchGymEnv::ScheduleNextStateRead ()
+{
+  NS_LOG_FUNCTION (this);
+  // sockets that are over keep their row, their actions are ignored
+  bool gameOver = m_envs.size() == m_socketNum;
+  for (uint32_t i = 0; i < m_envs.size(); i++) {
+    gameOver = m_envs[i]->CheckGameOver() && gameOver;
+  }
+  if (gameOver) {
+    // every row is over, this is the last step
+    m_isGameOver = true;
+  } else {
+    Simulator::Schedule (m_timeStep, &TcpTimeStepBatchGymEnv::ScheduleNextStateRead, this);
+  }
+  if (!m_localAgent && !m_interfaceBound) {
+    // ns3gym sends the spaces of the env the interface was bound to last,
+    // the per socket envs bind it when they are created
+    SetOpenGymInterface(OpenGymInterface::Get());
+    m_interfaceBound = true;
+  }
+  NotifyAgent();
+}
+
+uint32_t
+TcpTimeStepBatchGymEnv::GetObsRowSize() const
+{
+  return TcpTimeStepGymEnv::GetObsParameterNum(m_featureSet);
+}
+
+/*
+Define observation space: one row of TcpTimeStepGymEnv observations per socket,
+rows are identified by the socket UUID in the first column, rows of sockets
+that did not start yet are zero (UUID 0)
+*/
+Ptr<OpenGymSpace>
+TcpTimeStepBatchGymEnv::GetObservationSpace()
+{
+  if (m_obsSpace) {
+    return m_obsSpace;
+  }
+  uint32_t socketNum = m_socketNum;
+  uint32_t parameterNum = TcpTimeStepGymEnv::GetObsParameterNum(m_featureSet);
+  float low = 0.0;
+  float high = 1000000000.0;
+  std::vector<uint32_t> shape = {socketNum, parameterNum,};
+  std::string dtype = TypeNameGet<uint64_t> ();
+
+  Ptr<OpenGymBoxSpace> box = CreateObject<OpenGymBoxSpace> (low, high, shape, dtype);
+  NS_LOG_INFO ("MyGetObservationSpace: " << box);
+  m_obsSpace = box;
+  return box;
+}
+
+/*
+Define action space: one row of (ssThresh, cWnd) per socket, in observation row order
+*/
+Ptr<OpenGymSpace>
+TcpTimeStepBatchGymEnv::GetActionSpace()
+{
+  if (!m_actionSpace) {
+    m_actionSpace = CreateActionSpace(m_socketNum);
+  }
+  return m_actionSpace;
+}
+
+/*
+Collect observations of all sockets
+*/
+Ptr<OpenGymDataContainer>
+TcpTimeStepBatchGymEnv::GetObservation()
+{
+  m_obs.clear();
+  for (uint32_t i = 0; i < m_envs.size(); i++) {
+    m_envs[i]->FillObservation(m_obs);
+  }
+  m_obs.resize(m_socketNum * TcpTimeStepGymEnv::GetObsParameterNum(m_featureSet), 0);
+  Ptr<OpenGymBoxContainer<uint64_t> > box = SetObservationData(m_socketNum);
+
+  NS_LOG_INFO ("MyGetObservation: " << box);
+  return box;
+}
+
+// sum over all sockets, per socket rewards are in the extra info
+float
+TcpTimeStepBatchGymEnv::GetReward()
+{
+  float reward = 0.0;
+  for (uint32_t i = 0; i < m_envs.size(); i++) {
+    reward += m_envs[i]->GetReward();
+  }
+  NS_LOG_INFO("MyGetReward: " << reward);
+  return reward;
+}
+
+// "uuid:reward" pairs separated by ';', in row order
+std::string
+TcpTimeStepBatchGymEnv::GetExtraInfo()
+{
+  std::ostringstream info;
+  for (uint32_t i = 0; i < m_envs.size(); i++) {
+    if (i) {
+      info << ";";
+    }
+    info << m_envs[i]->GetSocketUuid() << ":" << m_envs[i]->GetReward();
+  }
+  m_info = info.str();
+  NS_LOG_INFO("MyGetExtraInfo: " << m_info);
+  return m_info;
+}
+
+bool
+TcpTimeStepBatchGymEnv::ExecuteActions(Ptr<OpenGymDataContainer> action)
+{
+  NS_LOG_INFO ("MyExecuteActions: " << action);
+  Ptr<OpenGymBoxContainer<uint32_t> > box = DynamicCast<OpenGymBoxContainer<uint32_t> >(action);
+  Ptr<OpenGymBoxContainer<float> > relative = DynamicCast<OpenGymBoxContainer<float> >(action);
+  Ptr<OpenGymBoxContainer<uint64_t> > segments = DynamicCast<OpenGymBoxContainer<uint64_t> >(action);
+  uint32_t valueNum = 0;
+  uint32_t stride = GetActionRowSize(m_actionMode);
+  if (box) {
+    valueNum = box->GetData().size();
+    // local agents answer with their own row width
+    stride = GetActionStride(box->GetShape(), m_actionMode);
+  } else if (relative) {
+    valueNum = relative->GetData().size();
+  } else if (segments) {
+    valueNum = segments->GetData().size();
+  } else {
+    return false;
+  }
+
+  // rows of sockets that did not start yet are ignored, as are the rows of
+  // sockets that joined after the agent computed the actions
+  uint32_t rowNum = std::min<uint32_t> (valueNum / stride, m_envs.size());
+  for (uint32_t i = 0; i < rowNum; i++) {
+    m_envs[i]->ExecuteActionRow(action, i);
+  }
+  m_actionRowNum = rowNum;
+  return true;
+}
+
+void
+TcpTimeStepBatchGymEnv::DropAction(bool late)
+{
+  for (uint32_t i = 0; i < m_actionRowNum; i++) {
+    m_envs[i]->DropAction(late);
+  }
+}
+
+// one trace record per socket that received an action
+void
+TcpTimeStepBatchGymEnv::RecordExchange()
+{
+  uint32_t width = TcpTimeStepGymEnv::GetObsParameterNum(m_featureSet);
+  for (uint32_t i = 0; i < m_actionRowNum && (i + 1) * width <= m_obs.size(); i++) {
+    m_envs[i]->RecordRow(&m_obs[i * width], width);
+  }
 }
 
 } // namespace ns3
@@ -3,7 +3,10 @@
 
 #include "ns3/opengym-module.h"
 #include "ns3/tcp-socket-base.h"
+#include "tcp-rl-stats.h"
 #include <vector>
+#include <string>
+#include <atomic>
 
 namespace ns3 {
 
@@ -11,6 +14,25 @@ class Packet;
 class TcpHeader;
 class TcpSocketBase;
 class Time;
+class TcpRlTraceRecorder;
+class TcpRlReward;
+
+
+/*
+Stands in for the agent process: actions are computed in-process from the
+observation, without an OpenGymInterface round trip.
+*/
+class TcpGymLocalAgent : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  virtual Ptr<OpenGymDataContainer> GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver) = 0;
+
+protected:
+  // values per observation row, the feature set decides
+  static uint32_t GetRowSize (Ptr<OpenGymBoxContainer<uint64_t> > obs);
+};
 
 
 class TcpGymEnv : public OpenGymEnv
@@ -23,6 +45,70 @@ public:
 
   void SetNodeId(uint32_t id);
   void SetSocketUuid(uint32_t id);
+  uint32_t GetSocketUuid() const;
+  void SetLocalAgent(Ptr<TcpGymLocalAgent> agent);
+  Ptr<TcpGymLocalAgent> GetLocalAgent() const;
+  // append every exchange (observation and applied action) to the trace
+  void SetRecorder(Ptr<TcpRlTraceRecorder> recorder);
+  void RecordRow(const uint64_t *obs, uint32_t obsNum);
+
+  // observation features, every set extends the previous one so the
+  // values they share keep their index
+  typedef enum
+  {
+    FEATURES_MINIMAL = 0, // window, bytes in flight, segments acked
+    FEATURES_BASIC,       // + RTT, time-step: also minRtt, inter packet times, throughput
+    FEATURES_FULL,        // time-step: + action latency, RTT distribution
+    FEATURES_EXTENDED,    // + congestion state, CA event, ECN state, event: also minRtt, called func
+  } FeatureSet_t;
+
+  virtual void SetFeatureSet(FeatureSet_t set);
+  FeatureSet_t GetFeatureSet() const;
+
+  // how an action row is read
+  typedef enum
+  {
+    ACTION_ABSOLUTE = 0,   // uint32 ssThresh, cWnd in bytes
+    ACTION_ADDITIVE,       // float ssThresh, cWnd changes in segments
+    ACTION_MULTIPLICATIVE, // float ssThresh, cWnd factors
+    ACTION_PACING,         // uint32 ssThresh, cWnd in bytes, pacing rate in kbit/s
+    ACTION_SEGMENTS,       // uint64 ssThresh, cWnd in segments
+    ACTION_LOG2,           // float log2 of ssThresh, cWnd in bytes
+  } ActionMode_t;
+
+  void SetActionMode(ActionMode_t mode);
+  ActionMode_t GetActionMode() const;
+  // values per action row
+  static uint32_t GetActionRowSize(ActionMode_t mode);
+  // values per row of an action box: {rows, width} boxes bring their own,
+  // local agents answer (ssThresh, cWnd[, pacing rate]) rows in every mode
+  static uint32_t GetActionStride(const std::vector<uint32_t> &shape, ActionMode_t mode);
+  // ACTION_PACING: the socket sends at the rate of the last action
+  void ApplyPacing(Ptr<TcpSocketState> tcb);
+
+  // wall clock limit of one agent exchange, 0: none
+  void SetActionDeadline(Time deadline);
+  Time GetActionDeadline() const;
+  // false until the first action and after a late or out of bounds one,
+  // the window is left to the delegate of the congestion control then
+  bool HasAgentAction() const;
+  // the last action does not count, late: it missed the deadline
+  virtual void DropAction(bool late);
+
+  // early end of the socket's episode, a condition has to hold for the
+  // patience time; the delegate keeps the window once it is over
+  void SetCwndCollapse(uint32_t segments); // cWnd below this many segments, 0: off
+  void SetZeroGoodputStop(bool value);     // no segment acked
+  void SetRttLimit(double factor);         // RTT above factor x minRtt, 0: off
+  void SetTerminationPatience(Time value);
+  bool IsGameOver() const;
+  // counts the socket's episode from its first data on (the receiving
+  // side never starts); sim.cc stops once every started env is over
+  void Register();
+  static uint32_t GetStartedNum();
+  static uint32_t GetRunningNum();
+  // replaces the env's reward and penalty unless its utility is Legacy
+  void SetRewardModel(Ptr<TcpRlReward> model);
 
   std::string GetTcpCongStateName(const TcpSocketState::TcpCongState_t state);
   std::string GetTcpCAEventName(const TcpSocketState::TcpCAEvent_t event);
@@ -33,21 +119,25 @@ public:
   virtual float GetReward();
   virtual std::string GetExtraInfo();
   virtual bool ExecuteActions(Ptr<OpenGymDataContainer> action);
+  // read the actions of one socket, row-th row of a (batched) action box
+  bool ExecuteActionRow(Ptr<OpenGymDataContainer> action, uint32_t row);
 
   virtual Ptr<OpenGymSpace> GetObservationSpace() = 0;
   virtual Ptr<OpenGymDataContainer> GetObservation() = 0;
+  // values per observation row, the feature set decides
+  virtual uint32_t GetObsRowSize() const = 0;
 
   // trace packets, e.g. for calculating inter tx/rx time
-  virtual void TxPktTrace(Ptr<const Packet>, const TcpHeader&, Ptr<const TcpSocketBase>) = 0;
-  virtual void RxPktTrace(Ptr<const Packet>, const TcpHeader&, Ptr<const TcpSocketBase>) = 0;
+  virtual void TxPktTrace(Ptr<const Packet>, const TcpHeader&, Ptr<const TcpSocketBase>) {}
+  virtual void RxPktTrace(Ptr<const Packet>, const TcpHeader&, Ptr<const TcpSocketBase>) {}
 
-  // TCP congestion control interface
-  virtual uint32_t GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight) = 0;
-  virtual void IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked) = 0;
+  // TCP congestion control interface, not used by envs that are not bound to a socket
+  virtual uint32_t GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight) { return 0; }
+  virtual void IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked) {}
   // optional functions used to collect obs
-  virtual void PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time& rtt) = 0;
-  virtual void CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState) = 0;
-  virtual void CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event) = 0;
+  virtual void PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time& rtt) {}
+  virtual void CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState) {}
+  virtual void CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event) {}
 
   typedef enum
   {
@@ -59,24 +149,71 @@ public:
   } CalledFunc_t;
 
 protected:
+  // send the current state to the agent (or the local agent) and apply its actions
+  void NotifyAgent();
+  // copy m_obs into the reused observation box, rowNum 0: one dimensional
+  Ptr<OpenGymBoxContainer<uint64_t> > SetObservationData(uint32_t rowNum);
+  // action space of the action mode, rowNum 0: one dimensional
+  Ptr<OpenGymSpace> CreateActionSpace(uint32_t rowNum);
+  // record m_obs with the action that was just applied
+  virtual void RecordExchange();
+  // an exchange from wall time start to end (ns) took longer than the deadline
+  bool PastDeadline(uint64_t start, uint64_t end) const;
+  // checked before every exchange with the values of the step, end: the
+  // duration is over
+  bool UpdateGameOver(bool end, uint64_t segmentsAcked, Time rtt);
+  // reward of the reward model for what was acked and lost over interval,
+  // the RTT gradient is taken against prevRtt
+  float ComputeModelReward(Time interval, uint64_t segmentsAcked, uint32_t lossNum, Time rtt, Time prevRtt);
+
   uint32_t m_nodeId;
   uint32_t m_socketUuid;
+  FeatureSet_t m_featureSet {FEATURES_FULL};
+  ActionMode_t m_actionMode {ACTION_ABSOLUTE};
+  Ptr<TcpGymLocalAgent> m_localAgent;
+  Ptr<TcpRlTraceRecorder> m_recorder;
 
   // state
   // obs has to be implemented in child class
+  // m_obs is built in place, no allocation once it has grown; the box is
+  // reused but SetData still allocates (see SetObservationData)
+  std::vector<uint64_t> m_obs;
+  Ptr<OpenGymBoxContainer<uint64_t> > m_obsBox;
+  uint32_t m_obsBoxRowNum {0};
+  uint32_t m_obsBoxSize {0};
+  Ptr<OpenGymSpace> m_obsSpace;
+  Ptr<OpenGymSpace> m_actionSpace;
 
   // game over
-  bool m_isGameOver;
+  bool m_registered {false};
+  bool m_isGameOver {false};
+  uint32_t m_cwndCollapse {0};
+  bool m_zeroGoodputStop {false};
+  double m_rttLimit {0.0};
+  Time m_terminationPatience;
+  // since when each condition holds, negative while it does not
+  Time m_cwndCollapseSince {Seconds (-1)};
+  Time m_zeroGoodputSince {Seconds (-1)};
+  Time m_rttLimitSince {Seconds (-1)};
 
   // reward
-  float m_envReward;
+  float m_envReward {0.0};
+  Ptr<TcpRlReward> m_rewardModel;
 
   // extra info
   std::string m_info;
 
+  // socket state, set by the congestion control callbacks
+  Ptr<const TcpSocketState> m_tcb;
+
   // actions
-  uint32_t m_new_ssThresh;
-  uint32_t m_new_cWnd;
+  Time m_actionDeadline;
+  bool m_agentAction {false};
+  uint64_t m_lateActionNum {0};
+  uint64_t m_invalidActionNum {0};
+  uint32_t m_new_ssThresh {0};
+  uint32_t m_new_cWnd {0};
+  uint64_t m_new_pacingRate {0}; // bit/s, 0 leaves pacing to the socket
 };
 
 
@@ -91,6 +228,22 @@ public:
   void SetReward(float value);
   void SetPenalty(float value);
 
+  // when IncreaseWindow notifies the agent, losses (GetSsThresh) always do
+  typedef enum
+  {
+    NOTIFY_EVERY_ACK = 0,
+    NOTIFY_EVERY_N_ACKS,
+    NOTIFY_PER_RTT,
+    NOTIFY_ON_CHANGE,
+  } NotifyMode_t;
+
+  void SetNotifyMode(NotifyMode_t mode);
+  void SetNotifyAckNum(uint32_t value);
+  void SetNotifyThreshold(double value);
+  virtual void SetFeatureSet(FeatureSet_t set);
+  static uint32_t GetObsParameterNum(FeatureSet_t set);
+  virtual uint32_t GetObsRowSize() const;
+
   // OpenGym interface
   virtual Ptr<OpenGymSpace> GetObservationSpace();
   Ptr<OpenGymDataContainer> GetObservation();
@@ -108,14 +261,35 @@ public:
   virtual void CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event);
 
 private:
+  // the feature set is a template argument, its unused features compile away
+  template <FeatureSet_t S>
+  void FillFeatures();
+  void (TcpEventGymEnv::*m_fillFeatures)() {&TcpEventGymEnv::FillFeatures<FEATURES_FULL>};
+
+  bool ShouldNotify();
+  // notify the agent with everything aggregated since the last notification
+  void NotifyAggregated();
+  static bool Moved(double value, double lastValue, double threshold);
+
+  // decimation
+  NotifyMode_t m_notifyMode {NOTIFY_EVERY_ACK};
+  uint32_t m_notifyAckNum {1};
+  double m_notifyThreshold {0.0};
+  bool m_notified {false};
+  uint32_t m_ackNum {0};
+  Time m_lastNotifyTime;
+  uint32_t m_lastNotifyCWnd {0};
+  uint32_t m_lastNotifyBytesInFlight {0};
+  Time m_lastNotifyRtt;
+
   // state
   CalledFunc_t m_calledFunc;
-  Ptr<const TcpSocketState> m_tcb;
-  uint32_t m_bytesInFlight;
-  uint32_t m_segmentsAcked;
+  uint32_t m_bytesInFlight {0};
+  uint32_t m_segmentsAcked {0};
   Time m_rtt;
+  uint32_t m_lossNum {0};
   TcpSocketState::TcpCongState_t m_newState;
-  TcpSocketState::TcpCAEvent_t m_event;
+  TcpSocketState::TcpCAEvent_t m_event {TcpSocketState::CA_EVENT_TX_START};
 
   // reward
   float m_reward;
@@ -123,6 +297,18 @@ private:
 };
 
 
+// one pipelined exchange, serialized on the simulator thread and sent by
+// the agent worker
+struct TcpRlAgentExchange
+{
+  std::string request;  // EnvStateMsg
+  std::string reply;    // EnvActMsg
+  uint64_t start {0};   // wall time ns
+  uint64_t end {0};
+  std::atomic<bool> done {true};
+};
+
+
 class TcpTimeStepGymEnv : public TcpGymEnv
 {
 public:
@@ -136,10 +322,29 @@ public:
   void SetTimeStep(Time value);
   void SetReward(float value);
   void SetPenalty(float value);
+  void SetBatched(bool value);
+  void SetBatchSize(uint32_t value);
+  void SetAsync(bool value);
+  // port of the agent, pipelined exchanges open their own connection to it
+  void SetAgentPort(uint32_t value);
+  // collect observations only, the window stays with another controller
+  void SetObserveOnly(bool value);
+  virtual void SetFeatureSet(FeatureSet_t set);
+  static uint32_t GetObsParameterNum(FeatureSet_t set);
+  virtual uint32_t GetObsRowSize() const;
 
   // OpenGym interface
   virtual Ptr<OpenGymSpace> GetObservationSpace();
   Ptr<OpenGymDataContainer> GetObservation();
+  virtual bool GetGameOver();
+  virtual bool ExecuteActions(Ptr<OpenGymDataContainer> action);
+
+  // append this socket's observation row to obs and start a new step
+  void FillObservation(std::vector<uint64_t> &obs);
+  // before the exchange of a step, true once the socket's episode is over
+  bool CheckGameOver();
+  static const uint32_t m_obsParameterNum = 22;  // FEATURES_FULL
+  static const uint32_t m_obsParameterMax = 25;  // FEATURES_EXTENDED
 
   // trace packets, e.g. for calculating inter tx/rx time
   virtual void TxPktTrace(Ptr<const Packet>, const TcpHeader&, Ptr<const TcpSocketBase>);
@@ -155,17 +360,42 @@ public:
 
 private:
   void ScheduleNextStateRead();
+  void Start();
+  Ptr<OpenGymDataContainer> BuildObservation();
+  // the feature set is a template argument, its unused features compile away
+  template <FeatureSet_t S>
+  void FillFeatures(std::vector<uint64_t> &obs);
+  void (TcpTimeStepGymEnv::*m_fillFeatures)(std::vector<uint64_t> &obs) {&TcpTimeStepGymEnv::FillFeatures<FEATURES_FULL>};
+  Time GetAvgRtt() const;
+  // pipelined mode: send the step t observation, keep the step t-1 action
+  void NotifyAgentAsync(bool wait);
+  // hand the snapshot to the agent worker
+  void SubmitExchange();
+  // wait for the submitted exchange and take its action
+  void FinishExchange();
+  void ApplyPendingAction();
   bool m_started {false};
+  bool m_batched {false};
+  uint32_t m_batchSize {1};
+  bool m_async {false};
+  bool m_observeOnly {false};
+  uint32_t m_agentPort {5555};
+  bool m_exchangePending {false};
+  TcpRlAgentExchange m_exchange;
+  bool m_exchangeLate {false};
+  Ptr<OpenGymDataContainer> m_obsSnapshot;
+  bool m_gameOverSnapshot {false};
+  Ptr<OpenGymDataContainer> m_pendingAction;
   Time m_duration;
   Time m_timeStep;
 
   // state
-  Ptr<const TcpSocketState> m_tcb;
-  std::vector<uint32_t> m_bytesInFlight;
-  std::vector<uint32_t> m_segmentsAcked;
+  TcpRlStreamStats m_bytesInFlight;
+  TcpRlStreamStats m_segmentsAcked;
+  uint32_t m_lossNum {0};
 
-  uint64_t m_rttSampleNum {0};
-  Time m_rttSum {MicroSeconds (0.0)};
+  TcpRlStreamStats m_rtt;             // ns
+  TcpRlLogHistogram m_rttHistogram;   // us
 
   Time m_lastPktTxTime {MicroSeconds(0.0)};
   Time m_lastPktRxTime {MicroSeconds(0.0)};
@@ -177,6 +407,7 @@ private:
   Time m_totalAvgRttSum {MicroSeconds (0.0)};
   uint64_t m_totalAvgRttNum {0};
   uint32_t m_old_cWnd {0};
+  TcpSocketState::TcpCAEvent_t m_event {TcpSocketState::CA_EVENT_TX_START};
 
   // reward
   float m_reward;
@@ -184,6 +415,49 @@ private:
 };
 
 
+/*
+All time-step sockets that share one step clock, exchanged with the agent
+as a single observation matrix (one row per socket) and action matrix.
+*/
+class TcpTimeStepBatchGymEnv : public TcpGymEnv
+{
+public:
+  TcpTimeStepBatchGymEnv ();
+  virtual ~TcpTimeStepBatchGymEnv ();
+  static TypeId GetTypeId (void);
+  virtual void DoDispose ();
+
+  // socketNum: rows of the matrices, fixed before the spaces are sent
+  static Ptr<TcpTimeStepBatchGymEnv> Get (Time timeStep, uint32_t socketNum);
+  void AddSocketEnv(Ptr<TcpTimeStepGymEnv> env);
+
+  virtual uint32_t GetObsRowSize() const;
+
+  // OpenGym interface
+  virtual Ptr<OpenGymSpace> GetObservationSpace();
+  virtual Ptr<OpenGymSpace> GetActionSpace();
+  Ptr<OpenGymDataContainer> GetObservation();
+  virtual float GetReward();
+  virtual std::string GetExtraInfo();
+  virtual bool ExecuteActions(Ptr<OpenGymDataContainer> action);
+  // a late matrix drops the action of every socket it answered
+  virtual void DropAction(bool late);
+
+protected:
+  virtual void RecordExchange();
+
+private:
+  static Ptr<TcpTimeStepBatchGymEnv> *DoGet (void);
+  static void Delete (void);
+  void ScheduleNextStateRead();
+
+  bool m_started {false};
+  bool m_interfaceBound {false};
+  Time m_timeStep;
+  uint32_t m_socketNum {0};
+  std::vector<Ptr<TcpTimeStepGymEnv> > m_envs;
+  uint32_t m_actionRowNum {0};
+};
 
 } // namespace ns3
 
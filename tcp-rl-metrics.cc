@@ -0,0 +1,111 @@
+#include "tcp-rl-metrics.h"
+#include "ns3/log.h"
+#include <cstring>
+#include <cerrno>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ns3::TcpRlMetricsWriter");
+
+// bytes collected before the thread writes them
+static const uint32_t CHUNK_SIZE = 1 << 16;
+
+TcpRlMetricsWriter::TcpRlMetricsWriter ()
+{
+}
+
+TcpRlMetricsWriter::~TcpRlMetricsWriter ()
+{
+  Close ();
+}
+
+bool
+TcpRlMetricsWriter::Open (std::string fileName, std::string fields, uint32_t recordSize)
+{
+  NS_LOG_FUNCTION (this << fileName << fields << recordSize);
+  NS_ASSERT (!m_file);
+  m_file = std::fopen (fileName.c_str (), "wb");
+  if (!m_file) {
+    NS_LOG_ERROR ("Cannot create " << fileName << ": " << std::strerror (errno));
+    return false;
+  }
+
+  // records start 8 byte aligned
+  uint32_t headerSize = (16 + fields.size () + 1 + 7) / 8 * 8;
+  uint32_t version = 1;
+  std::vector<char> header (headerSize, 0);
+  std::memcpy (&header[0], "TRLM", 4);
+  std::memcpy (&header[4], &version, 4);
+  std::memcpy (&header[8], &headerSize, 4);
+  std::memcpy (&header[12], &recordSize, 4);
+  std::memcpy (&header[16], fields.data (), fields.size ());
+  std::fwrite (header.data (), 1, header.size (), m_file);
+
+  m_recordSize = recordSize;
+  m_buffer.reserve (CHUNK_SIZE + recordSize);
+  m_pending.reserve (CHUNK_SIZE + recordSize);
+  m_closing = false;
+  m_thread = std::thread (&TcpRlMetricsWriter::Run, this);
+  return true;
+}
+
+void
+TcpRlMetricsWriter::Write (const void *record)
+{
+  NS_ASSERT_MSG (m_file, "Metrics writer is not open");
+  const char *data = static_cast<const char *> (record);
+  m_buffer.insert (m_buffer.end (), data, data + m_recordSize);
+  if (m_buffer.size () >= CHUNK_SIZE) {
+    Flush ();
+  }
+}
+
+void
+TcpRlMetricsWriter::Flush ()
+{
+  std::unique_lock<std::mutex> lock (m_mutex);
+  m_cv.wait (lock, [this] { return m_pending.empty (); });
+  // the emptied pending buffer keeps its capacity for the next chunk
+  m_buffer.swap (m_pending);
+  m_cv.notify_all ();
+}
+
+void
+TcpRlMetricsWriter::Run ()
+{
+  std::unique_lock<std::mutex> lock (m_mutex);
+  while (true) {
+    m_cv.wait (lock, [this] { return !m_pending.empty () || m_closing; });
+    if (m_pending.empty ()) {
+      break;
+    }
+    // Flush does not touch m_pending until it is empty again
+    lock.unlock ();
+    std::fwrite (m_pending.data (), 1, m_pending.size (), m_file);
+    lock.lock ();
+    m_pending.clear ();
+    m_cv.notify_all ();
+  }
+}
+
+void
+TcpRlMetricsWriter::Close ()
+{
+  if (!m_file) {
+    return;
+  }
+  NS_LOG_FUNCTION (this);
+  if (!m_buffer.empty ()) {
+    Flush ();
+  }
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_closing = true;
+  }
+  m_cv.notify_all ();
+  m_thread.join ();
+  std::fclose (m_file);
+  m_file = nullptr;
+}
+
+} // namespace ns3
@@ -0,0 +1,57 @@
+#ifndef TCP_RL_METRICS_H
+#define TCP_RL_METRICS_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ns3 {
+
+
+/*
+Appends fixed size records to a binary file while the simulation runs,
+the file is written by a background thread (read_metrics in parse_metrics.py
+maps it with numpy).
+
+File layout, little endian:
+  char[4]  magic "TRLM"
+  uint32   version (1)
+  uint32   header size, records start here
+  uint32   record size
+  char[]   fields "name:type,...", numpy type codes (f8, u4, ...), zero padded
+  records
+*/
+class TcpRlMetricsWriter
+{
+public:
+  TcpRlMetricsWriter ();
+  ~TcpRlMetricsWriter ();
+
+  // the field sizes have to add up to recordSize
+  bool Open (std::string fileName, std::string fields, uint32_t recordSize);
+  void Write (const void *record);
+  // writes what is left and waits for the thread
+  void Close ();
+
+private:
+  // hands the filled buffer to the thread, waits while it is still busy
+  void Flush ();
+  void Run ();
+
+  FILE *m_file {nullptr};
+  uint32_t m_recordSize {0};
+  std::vector<char> m_buffer;  // filled by the simulation
+  std::vector<char> m_pending; // written by the thread
+  bool m_closing {false};
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_thread;
+};
+
+} // namespace ns3
+
+#endif /* TCP_RL_METRICS_H */
@@ -0,0 +1,424 @@
+#include "tcp-rl-policy.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include <fstream>
+#include <map>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ns3::TcpRlMlpPolicy");
+NS_OBJECT_ENSURE_REGISTERED (TcpRlMlpPolicy);
+
+// the agent ignores socket ID, env type, sim time and node ID
+static const uint32_t OBS_INPUT_OFFSET = 4;
+// floats per SIMD register, rows are padded to a multiple of it
+static const uint32_t SIMD_WIDTH = 8;
+// throughput of the observation, Basic feature set and up
+static const uint32_t OBS_THROUGHPUT = 15;
+// event env Extended rows: the callback that notified and the CA state
+static const uint32_t OBS_EVENT_CALLED_FUNC = 11;
+static const uint32_t OBS_EVENT_CONG_STATE = 12;
+
+TypeId
+TcpRlMlpPolicy::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlMlpPolicy")
+    .SetParent<TcpGymLocalAgent> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpRlMlpPolicy> ()
+  ;
+
+  return tid;
+}
+
+TcpRlMlpPolicy::TcpRlMlpPolicy ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlMlpPolicy::~TcpRlMlpPolicy ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<TcpRlMlpPolicy>
+TcpRlMlpPolicy::Get (std::string fileName)
+{
+  static std::map<std::string, Ptr<TcpRlMlpPolicy> > policies;
+  Ptr<TcpRlMlpPolicy> policy = policies[fileName];
+  if (!policy) {
+    policy = CreateObject<TcpRlMlpPolicy> ();
+    NS_ABORT_MSG_UNLESS (policy->Load (fileName), "Cannot load policy " << fileName);
+    policies[fileName] = policy;
+  }
+  return policy;
+}
+
+template <typename T>
+static bool
+ReadValue (std::ifstream &in, T &value)
+{
+  in.read (reinterpret_cast<char *> (&value), sizeof (T));
+  return in.good ();
+}
+
+bool
+TcpRlMlpPolicy::Load (std::string fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+  std::ifstream in (fileName.c_str (), std::ios::binary);
+  if (!in) {
+    NS_LOG_ERROR ("Cannot open " << fileName);
+    return false;
+  }
+
+  char magic[4];
+  uint32_t version = 0;
+  uint32_t layerNum = 0;
+  in.read (magic, sizeof (magic));
+  if (!in || std::memcmp (magic, "TRLP", sizeof (magic)) != 0
+      || !ReadValue (in, version) || version < 1 || version > 2
+      || !ReadValue (in, m_inputSize) || !ReadValue (in, layerNum)) {
+    NS_LOG_ERROR ("Bad policy header in " << fileName);
+    return false;
+  }
+  if (m_inputSize == 0 || m_inputSize > TcpTimeStepGymEnv::m_obsParameterMax - OBS_INPUT_OFFSET) {
+    NS_LOG_ERROR ("Policy input size " << m_inputSize << " does not match the observation");
+    return false;
+  }
+
+  m_layers.clear ();
+  uint32_t inSize = m_inputSize;
+  for (uint32_t l = 0; l < layerNum; l++) {
+    Layer layer;
+    uint32_t activation = 0;
+    if (!ReadValue (in, layer.outSize) || !ReadValue (in, activation) || activation > SOFTMAX) {
+      NS_LOG_ERROR ("Bad layer " << l << " in " << fileName);
+      return false;
+    }
+    layer.inSize = inSize;
+    layer.inStride = (inSize + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    layer.activation = static_cast<Activation_t> (activation);
+    layer.weights.assign (layer.outSize * layer.inStride, 0.0);
+    layer.bias.resize (layer.outSize);
+    for (uint32_t o = 0; o < layer.outSize; o++) {
+      in.read (reinterpret_cast<char *> (&layer.weights[o * layer.inStride]), inSize * sizeof (float));
+    }
+    in.read (reinterpret_cast<char *> (layer.bias.data ()), layer.outSize * sizeof (float));
+    if (!in) {
+      NS_LOG_ERROR ("Truncated layer " << l << " in " << fileName);
+      return false;
+    }
+    inSize = layer.outSize;
+    m_layers.push_back (layer);
+  }
+
+  uint32_t actionNum = 0;
+  if (m_layers.empty () || !ReadValue (in, actionNum)) {
+    NS_LOG_ERROR ("Missing layers or action table in " << fileName);
+    return false;
+  }
+  m_cWndDelta.resize (actionNum);
+  in.read (reinterpret_cast<char *> (m_cWndDelta.data ()), actionNum * sizeof (int32_t));
+  if ((actionNum && !in) || (actionNum && actionNum != GetOutputSize ()) || (!actionNum && GetOutputSize () != 2)) {
+    NS_LOG_ERROR ("Action table does not match the output layer in " << fileName);
+    return false;
+  }
+  m_recency = 0;
+  if (version >= 2 && !ReadValue (in, m_recency)) {
+    NS_LOG_ERROR ("Missing recency in " << fileName);
+    return false;
+  }
+  m_sockets.clear ();
+
+  m_input.assign (m_inputSize, 0.0);
+  m_output.assign (GetOutputSize (), 0.0);
+
+  // layer l reads m_activations[l] and writes m_activations[l + 1]
+  m_activations.resize (m_layers.size () + 1);
+  m_activations[0].assign (m_layers[0].inStride, 0.0);
+  for (uint32_t l = 0; l < m_layers.size (); l++) {
+    uint32_t stride = l + 1 < m_layers.size () ? m_layers[l + 1].inStride : m_layers[l].outSize;
+    m_activations[l + 1].assign (stride, 0.0);
+  }
+
+  NS_LOG_INFO ("Loaded policy " << fileName << " inputs: " << m_inputSize << " layers: " << layerNum
+               << " actions: " << actionNum);
+  return true;
+}
+
+uint32_t
+TcpRlMlpPolicy::GetInputSize () const
+{
+  return m_inputSize;
+}
+
+uint32_t
+TcpRlMlpPolicy::GetOutputSize () const
+{
+  return m_layers.empty () ? 0 : m_layers.back ().outSize;
+}
+
+// n is a multiple of SIMD_WIDTH
+float
+TcpRlMlpPolicy::Dot (const float *a, const float *b, uint32_t n)
+{
+#if defined(__AVX__)
+  __m256 acc = _mm256_setzero_ps ();
+  for (uint32_t i = 0; i < n; i += SIMD_WIDTH) {
+#if defined(__FMA__)
+    acc = _mm256_fmadd_ps (_mm256_loadu_ps (a + i), _mm256_loadu_ps (b + i), acc);
+#else
+    acc = _mm256_add_ps (acc, _mm256_mul_ps (_mm256_loadu_ps (a + i), _mm256_loadu_ps (b + i)));
+#endif
+  }
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (acc), _mm256_extractf128_ps (acc, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 0x1));
+  return _mm_cvtss_f32 (sum);
+#else
+  // independent lanes, vectorized by the compiler
+  float acc[SIMD_WIDTH] = {0};
+  for (uint32_t i = 0; i < n; i += SIMD_WIDTH) {
+    for (uint32_t k = 0; k < SIMD_WIDTH; k++) {
+      acc[k] += a[i + k] * b[i + k];
+    }
+  }
+  float sum = 0;
+  for (uint32_t k = 0; k < SIMD_WIDTH; k++) {
+    sum += acc[k];
+  }
+  return sum;
+#endif
+}
+
+void
+TcpRlMlpPolicy::Evaluate (const float *input, float *output)
+{
+  std::copy (input, input + m_inputSize, m_activations[0].begin ());
+
+  for (uint32_t l = 0; l < m_layers.size (); l++) {
+    const Layer &layer = m_layers[l];
+    const float *in = m_activations[l].data ();
+    float *out = m_activations[l + 1].data ();
+
+    for (uint32_t o = 0; o < layer.outSize; o++) {
+      float value = Dot (&layer.weights[o * layer.inStride], in, layer.inStride) + layer.bias[o];
+      switch (layer.activation) {
+        case RELU:
+          value = std::max (value, 0.0f);
+          break;
+        case TANH:
+          value = std::tanh (value);
+          break;
+        default:
+          break;
+      }
+      out[o] = value;
+    }
+
+    if (layer.activation == SOFTMAX) {
+      float maxValue = *std::max_element (out, out + layer.outSize);
+      float sum = 0;
+      for (uint32_t o = 0; o < layer.outSize; o++) {
+        out[o] = std::exp (out[o] - maxValue);
+        sum += out[o];
+      }
+      for (uint32_t o = 0; o < layer.outSize; o++) {
+        out[o] /= sum;
+      }
+    }
+  }
+
+  const std::vector<float> &result = m_activations.back ();
+  std::copy (result.begin (), result.begin () + GetOutputSize (), output);
+}
+
+uint32_t
+TcpRlMlpPolicy::ClampCWnd (const uint64_t *row, uint32_t width, uint32_t best)
+{
+  uint64_t ssThresh = row[4];
+  uint64_t cWnd = row[5];
+  std::unordered_map<uint64_t, SocketState>::iterator it = m_sockets.find (row[0]);
+  if (it == m_sockets.end ()) {
+    SocketState socket;
+    socket.initCWnd = cWnd;
+    socket.throughput.assign (m_recency, 0.0);
+    socket.stepNum = 0;
+    it = m_sockets.insert (std::make_pair (row[0], socket)).first;
+  }
+  SocketState &socket = it->second;
+
+  // the window may grow past ssThresh once the throughput stopped changing
+  uint64_t thresh = ssThresh;
+  if (m_recency && width > OBS_THROUGHPUT) {
+    double throughput = row[OBS_THROUGHPUT];
+    socket.throughput[socket.stepNum++ % m_recency] = throughput;
+    if (socket.stepNum >= m_recency) {
+      double mean = 0.0;
+      double variance = 0.0;
+      for (uint32_t i = 0; i < m_recency; i++) {
+        mean += socket.throughput[i];
+      }
+      mean /= m_recency;
+      for (uint32_t i = 0; i < m_recency; i++) {
+        variance += (socket.throughput[i] - mean) * (socket.throughput[i] - mean);
+      }
+      if (std::sqrt (variance / m_recency) < 0.01 * throughput) {
+        thresh = cWnd;
+      }
+    }
+  }
+
+  int64_t newCWnd = static_cast<int64_t> (cWnd) + m_cWndDelta[best];
+  newCWnd = std::min<int64_t> (static_cast<int64_t> (thresh), newCWnd);
+  return static_cast<uint32_t> (std::max<int64_t> (socket.initCWnd, newCWnd));
+}
+
+// raw regression output in bytes; NaN and negatives give 0, the cast is
+// only reached in range
+static uint32_t
+ClampOutput (float value)
+{
+  if (std::isnan (value)) {
+    return 0;
+  }
+  return static_cast<uint32_t> (std::max<double> (0.0, std::min<double> (value, 4294967295.0)));
+}
+
+/*
+One (ssThresh, cWnd) action per observation row, same rule as TCP-RL-Agent.py:
+the argmax output picks a cWnd delta, clamped by ClampCWnd, and ssThresh is
+half of the current cWnd
+*/
+Ptr<OpenGymDataContainer>
+TcpRlMlpPolicy::GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver)
+{
+  Ptr<OpenGymBoxContainer<uint64_t> > obsBox = DynamicCast<OpenGymBoxContainer<uint64_t> > (obs);
+  std::vector<uint64_t> data = obsBox->GetData ();
+  uint32_t width = GetRowSize (obsBox);
+  NS_ABORT_MSG_IF (OBS_INPUT_OFFSET + m_inputSize > width,
+                   "Policy takes " << m_inputSize << " inputs, the FeatureSet sends " << width << " values");
+  uint32_t rowNum = data.size () / width;
+
+  m_actionData.clear ();
+  for (uint32_t r = 0; r < rowNum; r++) {
+    const uint64_t *row = &data[r * width];
+    for (uint32_t i = 0; i < m_inputSize; i++) {
+      m_input[i] = static_cast<float> (row[OBS_INPUT_OFFSET + i]);
+    }
+    Evaluate (m_input.data (), m_output.data ());
+
+    uint32_t ssThresh;
+    uint32_t cWnd = row[5];
+    if (m_cWndDelta.empty ()) {
+      ssThresh = ClampOutput (m_output[0]);
+      cWnd = ClampOutput (m_output[1]);
+    } else {
+      uint32_t best = std::max_element (m_output.begin (), m_output.end ()) - m_output.begin ();
+      ssThresh = cWnd / 2;
+      cWnd = ClampCWnd (row, width, best);
+    }
+    m_actionData.push_back (ssThresh);
+    m_actionData.push_back (cWnd);
+  }
+
+  // the action is applied before the next call, the box can be reused
+  if (!m_action || m_actionRowNum != rowNum) {
+    std::vector<uint32_t> shape = {rowNum, 2,};
+    m_action = CreateObject<OpenGymBoxContainer<uint32_t> > (shape);
+    m_actionRowNum = rowNum;
+  }
+  m_action->SetData (m_actionData);
+  Ptr<OpenGymBoxContainer<uint32_t> > action = m_action;
+
+  NS_LOG_INFO ("MyGetAction: " << action);
+  return action;
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (TcpRlNewRenoAgent);
+
+TypeId
+TcpRlNewRenoAgent::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlNewRenoAgent")
+    .SetParent<TcpGymLocalAgent> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpRlNewRenoAgent> ()
+  ;
+
+  return tid;
+}
+
+TcpRlNewRenoAgent::TcpRlNewRenoAgent ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlNewRenoAgent::~TcpRlNewRenoAgent ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<OpenGymDataContainer>
+TcpRlNewRenoAgent::GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver)
+{
+  Ptr<OpenGymBoxContainer<uint64_t> > obsBox = DynamicCast<OpenGymBoxContainer<uint64_t> > (obs);
+  std::vector<uint64_t> data = obsBox->GetData ();
+  // env type: 0 event based, 1 time-step
+  bool timeStep = data.size () > 1 && data[1] == 1;
+  uint32_t width = GetRowSize (obsBox);
+  uint32_t rowNum = width ? data.size () / width : 0;
+
+  m_actionData.clear ();
+  for (uint32_t r = 0; r < rowNum; r++) {
+    const uint64_t *row = &data[r * width];
+    uint64_t ssThresh = row[4];
+    uint64_t cWnd = row[5];
+    uint64_t segmentSize = row[6];
+    // segments acked by this ACK, or during the whole step
+    uint64_t segmentsAcked = timeStep ? row[9] : row[7];
+    // bytes in flight, averaged over the step for time-step envs
+    uint64_t bytesInFlight = row[8];
+
+    if (cWnd < ssThresh) {
+      cWnd += segmentsAcked * segmentSize;
+    } else if (cWnd > 0) {
+      cWnd += std::max<uint64_t> (1, segmentsAcked * segmentSize * segmentSize / cWnd);
+    }
+    // a time-step answer is applied at a loss that has not happened yet
+    bool loss = true;
+    if (!timeStep && width > OBS_EVENT_CONG_STATE) {
+      loss = row[OBS_EVENT_CALLED_FUNC] == TcpGymEnv::GET_SS_THRESH
+             || row[OBS_EVENT_CONG_STATE] >= TcpSocketState::CA_CWR;
+    }
+    if (loss) {
+      ssThresh = std::max<uint64_t> (2 * segmentSize, bytesInFlight / 2);
+    }
+    m_actionData.push_back (std::min<uint64_t> (ssThresh, std::numeric_limits<uint32_t>::max ()));
+    m_actionData.push_back (std::min<uint64_t> (cWnd, std::numeric_limits<uint32_t>::max ()));
+  }
+
+  // the action is applied before the next call, the box can be reused
+  if (!m_action || m_actionRowNum != rowNum) {
+    std::vector<uint32_t> shape = {rowNum, 2,};
+    m_action = CreateObject<OpenGymBoxContainer<uint32_t> > (shape);
+    m_actionRowNum = rowNum;
+  }
+  m_action->SetData (m_actionData);
+  Ptr<OpenGymBoxContainer<uint32_t> > action = m_action;
+
+  NS_LOG_INFO ("MyGetAction: " << action);
+  return action;
+}
+
+} // namespace ns3
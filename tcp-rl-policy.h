@@ -0,0 +1,130 @@
+#ifndef TCP_RL_POLICY_H
+#define TCP_RL_POLICY_H
+
+#include "tcp-rl-env.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace ns3 {
+
+
+/*
+Small MLP exported from the agent (see export_policy in TCP-RL-Agent.py),
+evaluated in-process on every time-step observation.
+
+Binary file layout, little endian:
+  char[4]  magic "TRLP"
+  uint32   version (1 or 2)
+  uint32   input size (observation fields after socket ID, env type, sim time, node ID)
+  uint32   layer num
+  per layer:
+    uint32  output size
+    uint32  activation: 0 linear, 1 relu, 2 tanh, 3 softmax
+    float   weights[output size][input size], row major
+    float   bias[output size]
+  uint32   action num, 0: the outputs are (ssThresh, cWnd)
+  int32    cWnd delta in bytes[action num], applied for the argmax output
+  uint32   recency (version 2), steps of the throughput plateau check
+The new cWnd is clamped like in TCP-RL-Agent.py: at most ssThresh (cWnd
+once the throughput of the last recency steps deviates less than 1%), at
+least the socket's cWnd of its first observation.
+*/
+class TcpRlMlpPolicy : public TcpGymLocalAgent
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlMlpPolicy ();
+  virtual ~TcpRlMlpPolicy ();
+
+  // policies are shared by all sockets that use the same file
+  static Ptr<TcpRlMlpPolicy> Get (std::string fileName);
+
+  bool Load (std::string fileName);
+  uint32_t GetInputSize () const;
+  uint32_t GetOutputSize () const;
+  // input has GetInputSize () values, output GetOutputSize () values
+  void Evaluate (const float *input, float *output);
+
+  virtual Ptr<OpenGymDataContainer> GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver);
+
+  typedef enum
+  {
+    LINEAR = 0,
+    RELU,
+    TANH,
+    SOFTMAX,
+  } Activation_t;
+
+private:
+  struct Layer
+  {
+    uint32_t inSize;
+    uint32_t inStride;          // inSize rounded up to a whole SIMD register
+    uint32_t outSize;
+    Activation_t activation;
+    std::vector<float> weights; // outSize rows of inStride values, zero padded
+    std::vector<float> bias;
+  };
+
+  // what the agent keeps per socket for the window clamp
+  struct SocketState
+  {
+    uint32_t initCWnd;
+    std::vector<double> throughput; // ring of the last recency steps
+    uint32_t stepNum;
+  };
+
+  static float Dot (const float *a, const float *b, uint32_t n);
+  // the agent's window rule for the argmax output best of one observation row
+  uint32_t ClampCWnd (const uint64_t *row, uint32_t width, uint32_t best);
+
+  uint32_t m_inputSize {0};
+  std::vector<Layer> m_layers;
+  std::vector<int32_t> m_cWndDelta;
+  uint32_t m_recency {0};
+  std::unordered_map<uint64_t, SocketState> m_sockets;
+
+  // scratch buffers, one per layer boundary
+  std::vector<std::vector<float> > m_activations;
+  std::vector<float> m_input;
+  std::vector<float> m_output;
+
+  // reused for every action
+  Ptr<OpenGymBoxContainer<uint32_t> > m_action;
+  std::vector<uint32_t> m_actionData;
+  uint32_t m_actionRowNum {0};
+};
+
+
+/*
+Stand-in for the agent in benchmarks: NewReno computed from the event
+or time-step observation (one row per socket), any feature set.
+ssThresh stays the observed one and is only reduced to half the bytes in
+flight when the row shows a loss: an event row sent from GetSsThresh or
+in a CWR, Recovery or Loss state (Extended). Rows without those fields
+answer with the reduced value, the envs only apply it at a loss: event
+envs when GetSsThresh notifies, time-step envs at the next loss of the
+step.
+*/
+class TcpRlNewRenoAgent : public TcpGymLocalAgent
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlNewRenoAgent ();
+  virtual ~TcpRlNewRenoAgent ();
+
+  virtual Ptr<OpenGymDataContainer> GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver);
+
+private:
+  // reused for every action
+  Ptr<OpenGymBoxContainer<uint32_t> > m_action;
+  std::vector<uint32_t> m_actionData;
+  uint32_t m_actionRowNum {0};
+};
+
+} // namespace ns3
+
+#endif /* TCP_RL_POLICY_H */
@@ -0,0 +1,162 @@
+#include "tcp-rl-profiler.h"
+#include "tcp-rl-stats.h"
+#include "tcp-rl-metrics.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include <mutex>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ns3::TcpRlProfiler");
+
+bool TcpRlProfiler::s_enabled = false;
+
+static const char *PROBE_NAMES[TcpRlProfiler::PROBE_NUM] = {
+  "Notify",
+  "IncreaseWindow",
+  "GetSsThresh",
+  "PktsAcked",
+  "CongestionStateSet",
+  "CwndEvent",
+};
+
+struct ProbeStats
+{
+  TcpRlStreamStats total;    // ns
+  TcpRlLogHistogram latency; // ns
+  TcpRlStreamStats interval; // ns, reset by Sample
+};
+
+// one record per sample interval
+struct ProfileRecord
+{
+  double time;          // simulated s
+  double wallTime;      // s since Enable
+  double eventRate;     // simulated events per wall s in the interval
+  double speed;         // simulated s per wall s in the interval
+  double notifyMean;    // wall s of a round trip in the interval
+  double notifyMax;
+  double callbackTime;  // wall s in the callbacks in the interval
+  uint32_t notifyNum;
+  uint32_t callbackNum;
+};
+static const char *PROFILE_FIELDS = "time:f8,wallTime:f8,eventRate:f8,speed:f8,notifyMean:f8,notifyMax:f8,"
+                                    "callbackTime:f8,notifyNum:u4,callbackNum:u4";
+
+static ProbeStats g_probes[TcpRlProfiler::PROBE_NUM];
+// async envs record Notify from their agent thread
+static std::mutex g_notifyMutex;
+static TcpRlMetricsWriter g_profileWriter;
+static uint64_t g_startWallTime = 0;
+static uint64_t g_lastWallTime = 0;
+static uint64_t g_lastEventCount = 0;
+static double g_lastSimTime = 0.0;
+
+void
+TcpRlProfiler::Enable (double interval, std::string fileName)
+{
+  NS_LOG_FUNCTION (interval << fileName);
+  if (s_enabled) {
+    return;
+  }
+  s_enabled = true;
+  g_startWallTime = GetWallTime ();
+  g_lastWallTime = g_startWallTime;
+  g_lastEventCount = Simulator::GetEventCount ();
+  g_lastSimTime = Simulator::Now ().GetSeconds ();
+
+  if (interval > 0) {
+    NS_ABORT_MSG_UNLESS (g_profileWriter.Open (fileName, PROFILE_FIELDS, sizeof (ProfileRecord)),
+                         "Cannot open " << fileName);
+    Simulator::Schedule (Seconds (interval), &TcpRlProfiler::Sample, interval);
+  }
+  Simulator::ScheduleDestroy (&TcpRlProfiler::PrintSummary);
+}
+
+void
+TcpRlProfiler::Record (Probe_t probe, uint64_t wallTime)
+{
+  std::unique_lock<std::mutex> lock (g_notifyMutex, std::defer_lock);
+  if (probe == NOTIFY) {
+    lock.lock ();
+  }
+  ProbeStats &stats = g_probes[probe];
+  stats.total.Add (wallTime);
+  stats.latency.Add (wallTime);
+  stats.interval.Add (wallTime);
+}
+
+void
+TcpRlProfiler::Sample (double interval)
+{
+  uint64_t wallTime = GetWallTime ();
+  uint64_t eventCount = Simulator::GetEventCount ();
+  double simTime = Simulator::Now ().GetSeconds ();
+  double wall = (wallTime - g_lastWallTime) * 1e-9;
+
+  ProfileRecord record = {};
+  record.time = simTime;
+  record.wallTime = (wallTime - g_startWallTime) * 1e-9;
+  if (wall > 0) {
+    record.eventRate = (eventCount - g_lastEventCount) / wall;
+    record.speed = (simTime - g_lastSimTime) / wall;
+  }
+  {
+    std::lock_guard<std::mutex> lock (g_notifyMutex);
+    TcpRlStreamStats &notify = g_probes[NOTIFY].interval;
+    record.notifyMean = notify.GetMean () * 1e-9;
+    record.notifyMax = notify.GetMax () * 1e-9;
+    record.notifyNum = notify.GetCount ();
+    notify.Reset ();
+  }
+  for (uint32_t i = NOTIFY + 1; i < PROBE_NUM; i++) {
+    record.callbackTime += g_probes[i].interval.GetSum () * 1e-9;
+    record.callbackNum += g_probes[i].interval.GetCount ();
+    g_probes[i].interval.Reset ();
+  }
+  g_profileWriter.Write (&record);
+
+  g_lastWallTime = wallTime;
+  g_lastEventCount = eventCount;
+  g_lastSimTime = simTime;
+  Simulator::Schedule (Seconds (interval), &TcpRlProfiler::Sample, interval);
+}
+
+void
+TcpRlProfiler::PrintSummary ()
+{
+  g_profileWriter.Close ();
+
+  double wall = (GetWallTime () - g_startWallTime) * 1e-9;
+  double simTime = Simulator::Now ().GetSeconds ();
+  uint64_t events = Simulator::GetEventCount ();
+  NS_LOG_UNCOND ("Profile:");
+  NS_LOG_UNCOND ("---Wall: " << wall << "s Simulated: " << simTime << "s Ratio: " << (wall > 0 ? simTime / wall : 0)
+                 << " Events: " << events << " Events/s: " << (wall > 0 ? events / wall : 0));
+
+  // callbacks of event based envs include the Notify they trigger
+  std::lock_guard<std::mutex> lock (g_notifyMutex);
+  for (uint32_t i = 0; i < PROBE_NUM; i++) {
+    const ProbeStats &probe = g_probes[i];
+    if (!probe.total.GetCount ()) {
+      continue;
+    }
+    NS_LOG_UNCOND ("---" << PROBE_NAMES[i] << ": " << probe.total.GetCount ()
+                   << " Wall: " << probe.total.GetSum () * 1e-9 << "s"
+                   << " (" << (wall > 0 ? probe.total.GetSum () * 1e-7 / wall : 0) << "%)"
+                   << " Mean: " << probe.total.GetMean () * 1e-3 << "us"
+                   << " p50: " << probe.latency.GetPercentile (0.5) * 1e-3 << "us"
+                   << " p99: " << probe.latency.GetPercentile (0.99) * 1e-3 << "us"
+                   << " Max: " << probe.total.GetMax () * 1e-3 << "us");
+  }
+
+  // every episode of sim.cc --episodes enables its own profile
+  for (uint32_t i = 0; i < PROBE_NUM; i++) {
+    g_probes[i].total.Reset ();
+    g_probes[i].latency.Reset ();
+    g_probes[i].interval.Reset ();
+  }
+  s_enabled = false;
+}
+
+} // namespace ns3
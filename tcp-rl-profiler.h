@@ -0,0 +1,78 @@
+#ifndef TCP_RL_PROFILER_H
+#define TCP_RL_PROFILER_H
+
+#include <stdint.h>
+#include <string>
+#include <chrono>
+
+namespace ns3 {
+
+
+/*
+Wall-clock counters for the hot paths: agent round trips (Notify or the
+local agent) and the TcpRlBase congestion control callbacks. Prints a
+summary with the event rate and the simulated/wall time ratio at
+Simulator::Destroy, and optionally writes a time series (profile.bin,
+see read_metrics in parse_metrics.py).
+
+Disabled it costs one branch per probe.
+*/
+class TcpRlProfiler
+{
+public:
+  enum Probe_t {
+    NOTIFY,
+    INCREASE_WINDOW,
+    GET_SS_THRESH,
+    PKTS_ACKED,
+    CONGESTION_STATE_SET,
+    CWND_EVENT,
+    PROBE_NUM,
+  };
+
+  // interval in simulated seconds, 0 only prints the summary
+  static void Enable (double interval, std::string fileName);
+  static bool IsEnabled ()
+  {
+    return s_enabled;
+  }
+
+  // wall clock in ns
+  static uint64_t GetWallTime ()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (
+      std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+  }
+  static void Record (Probe_t probe, uint64_t wallTime);
+
+  // times the enclosing block
+  class Scope
+  {
+  public:
+    Scope (Probe_t probe)
+      : m_probe (probe),
+        m_start (IsEnabled () ? GetWallTime () : 0)
+    {
+    }
+    ~Scope ()
+    {
+      if (m_start) {
+        Record (m_probe, GetWallTime () - m_start);
+      }
+    }
+
+  private:
+    Probe_t m_probe;
+    uint64_t m_start;
+  };
+
+private:
+  static void Sample (double interval);
+  static void PrintSummary ();
+
+  static bool s_enabled;
+};
+
+} // namespace ns3
+
+#endif /* TCP_RL_PROFILER_H */
@@ -0,0 +1,267 @@
+#include "tcp-rl-replay.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <cstring>
+#include <algorithm>
+
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ns3::TcpRlReplayAgent");
+NS_OBJECT_ENSURE_REGISTERED (TcpRlTraceRecorder);
+NS_OBJECT_ENSURE_REGISTERED (TcpRlReplayAgent);
+
+const uint32_t TcpRlTraceRecord::OBS_CAPACITY;
+
+// index of the action latency in time-step observations, FEATURES_FULL and up
+static const uint32_t OBS_ACTION_LATENCY = 16;
+
+static std::map<std::string, Ptr<TcpRlTraceRecorder> > g_recorders;
+static std::map<std::string, Ptr<TcpRlReplayAgent> > g_replayAgents;
+
+TypeId
+TcpRlTraceRecorder::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlTraceRecorder")
+    .SetParent<Object> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpRlTraceRecorder> ()
+  ;
+
+  return tid;
+}
+
+TcpRlTraceRecorder::TcpRlTraceRecorder ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlTraceRecorder::~TcpRlTraceRecorder ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<TcpRlTraceRecorder>
+TcpRlTraceRecorder::Get (std::string fileName)
+{
+  std::map<std::string, Ptr<TcpRlTraceRecorder> >::iterator it = g_recorders.find (fileName);
+  if (it != g_recorders.end ()) {
+    return it->second;
+  }
+
+  Ptr<TcpRlTraceRecorder> recorder = CreateObject<TcpRlTraceRecorder> ();
+  NS_ABORT_MSG_UNLESS (recorder->Open (fileName), "Cannot create trace " << fileName);
+  if (g_recorders.empty ()) {
+    Simulator::ScheduleDestroy (&TcpRlTraceRecorder::CloseAll);
+  }
+  g_recorders[fileName] = recorder;
+  return recorder;
+}
+
+void
+TcpRlTraceRecorder::CloseAll ()
+{
+  for (std::map<std::string, Ptr<TcpRlTraceRecorder> >::iterator it = g_recorders.begin (); it != g_recorders.end (); ++it) {
+    it->second->Close ();
+  }
+  g_recorders.clear ();
+}
+
+bool
+TcpRlTraceRecorder::Open (std::string fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+  std::ostringstream fields;
+  fields << "time:f8,socketUuid:u4,obsNum:u4,ssThresh:u4,cWnd:u4,pacingRate:u8";
+  for (uint32_t i = 0; i < TcpRlTraceRecord::OBS_CAPACITY; i++) {
+    fields << ",obs" << i << ":u8";
+  }
+  return m_writer.Open (fileName, fields.str (), sizeof (TcpRlTraceRecord));
+}
+
+void
+TcpRlTraceRecorder::Close ()
+{
+  NS_LOG_FUNCTION (this);
+  m_writer.Close ();
+}
+
+void
+TcpRlTraceRecorder::Record (uint32_t socketUuid, const uint64_t *obs, uint32_t obsNum, uint32_t ssThresh, uint32_t cWnd,
+                            uint64_t pacingRate)
+{
+  NS_ASSERT_MSG (obsNum <= TcpRlTraceRecord::OBS_CAPACITY, "Observation has more than " << TcpRlTraceRecord::OBS_CAPACITY << " values");
+  m_record.time = Simulator::Now ().GetSeconds ();
+  m_record.socketUuid = socketUuid;
+  m_record.obsNum = obsNum;
+  m_record.ssThresh = ssThresh;
+  m_record.cWnd = cWnd;
+  m_record.pacingRate = pacingRate;
+  std::copy (obs, obs + obsNum, m_record.obs);
+  std::fill (m_record.obs + obsNum, m_record.obs + TcpRlTraceRecord::OBS_CAPACITY, 0);
+  m_writer.Write (&m_record);
+}
+
+
+TypeId
+TcpRlReplayAgent::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlReplayAgent")
+    .SetParent<TcpGymLocalAgent> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpRlReplayAgent> ()
+  ;
+
+  return tid;
+}
+
+TcpRlReplayAgent::TcpRlReplayAgent ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlReplayAgent::~TcpRlReplayAgent ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<TcpRlReplayAgent>
+TcpRlReplayAgent::Get (std::string fileName)
+{
+  std::map<std::string, Ptr<TcpRlReplayAgent> >::iterator it = g_replayAgents.find (fileName);
+  if (it != g_replayAgents.end ()) {
+    return it->second;
+  }
+
+  Ptr<TcpRlReplayAgent> agent = CreateObject<TcpRlReplayAgent> ();
+  NS_ABORT_MSG_UNLESS (agent->Load (fileName), "Cannot load trace " << fileName);
+  if (g_replayAgents.empty ()) {
+    Simulator::ScheduleDestroy (&TcpRlReplayAgent::ReportAll);
+  }
+  g_replayAgents[fileName] = agent;
+  return agent;
+}
+
+void
+TcpRlReplayAgent::ReportAll ()
+{
+  for (std::map<std::string, Ptr<TcpRlReplayAgent> >::iterator it = g_replayAgents.begin (); it != g_replayAgents.end (); ++it) {
+    it->second->Report ();
+  }
+  g_replayAgents.clear ();
+}
+
+bool
+TcpRlReplayAgent::Load (std::string fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+  std::ifstream file (fileName.c_str (), std::ios::binary);
+  if (!file) {
+    NS_LOG_ERROR ("Cannot open " << fileName);
+    return false;
+  }
+
+  char magic[4];
+  uint32_t version, headerSize, recordSize;
+  file.read (magic, sizeof (magic));
+  file.read (reinterpret_cast<char *> (&version), sizeof (version));
+  file.read (reinterpret_cast<char *> (&headerSize), sizeof (headerSize));
+  file.read (reinterpret_cast<char *> (&recordSize), sizeof (recordSize));
+  if (!file || std::memcmp (magic, "TRLM", sizeof (magic)) != 0 || version != 1) {
+    NS_LOG_ERROR (fileName << " is not a trace file");
+    return false;
+  }
+  if (recordSize != sizeof (TcpRlTraceRecord)) {
+    NS_LOG_ERROR (fileName << " has " << recordSize << " byte records, expected " << sizeof (TcpRlTraceRecord));
+    return false;
+  }
+
+  file.seekg (0, std::ios::end);
+  uint64_t recordNum = (static_cast<uint64_t> (file.tellg ()) - headerSize) / recordSize;
+  file.seekg (headerSize);
+  m_records.resize (recordNum);
+  file.read (reinterpret_cast<char *> (m_records.data ()), recordNum * recordSize);
+  if (!file) {
+    NS_LOG_ERROR ("Cannot read " << fileName);
+    return false;
+  }
+
+  for (uint32_t i = 0; i < m_records.size (); i++) {
+    m_sockets[m_records[i].socketUuid].records.push_back (i);
+  }
+  m_fileName = fileName;
+  NS_LOG_INFO ("Loaded " << recordNum << " exchanges of " << m_sockets.size () << " sockets from " << fileName);
+  return true;
+}
+
+void
+TcpRlReplayAgent::Report ()
+{
+  NS_LOG_UNCOND ("Replay " << m_fileName << ": " << m_replayNum << " actions, "
+                 << m_mismatchNum << " diverged observations, " << m_missingNum << " without a recorded action");
+}
+
+Ptr<OpenGymDataContainer>
+TcpRlReplayAgent::GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver)
+{
+  Ptr<OpenGymBoxContainer<uint64_t> > obsBox = DynamicCast<OpenGymBoxContainer<uint64_t> > (obs);
+  std::vector<uint64_t> data = obsBox->GetData ();
+  // env type: 0 event based, 1 time-step
+  bool timeStep = data.size () > 1 && data[1] == 1;
+  uint32_t width = GetRowSize (obsBox);
+  uint32_t rowNum = width ? data.size () / width : 0;
+
+  m_actionData.clear ();
+  for (uint32_t r = 0; r < rowNum; r++) {
+    const uint64_t *row = &data[r * width];
+    std::unordered_map<uint32_t, SocketTrace>::iterator it = m_sockets.find (row[0]);
+    if (it == m_sockets.end () || it->second.next >= it->second.records.size ()) {
+      // keep the current window
+      if (!m_missingNum++) {
+        NS_LOG_WARN ("No recorded action for socket " << row[0] << " at " << Simulator::Now ().GetSeconds () << "s");
+      }
+      m_actionData.push_back (row[4]);
+      m_actionData.push_back (row[5]);
+      m_actionData.push_back (0);
+      continue;
+    }
+
+    SocketTrace &socket = it->second;
+    uint32_t step = socket.next++;
+    const TcpRlTraceRecord &record = m_records[socket.records[step]];
+    bool mismatch = record.obsNum != width;
+    for (uint32_t i = 0; i < width && !mismatch; i++) {
+      // the replay itself runs synchronously
+      mismatch = (timeStep && i == OBS_ACTION_LATENCY) ? false : record.obs[i] != row[i];
+    }
+    if (mismatch && !m_mismatchNum++) {
+      NS_LOG_WARN ("Socket " << row[0] << " diverged from the trace at " << Simulator::Now ().GetSeconds () << "s");
+    }
+
+    // an async agent's step k action was applied at step k + 1
+    bool pipelined = timeStep && width > OBS_ACTION_LATENCY && record.obs[OBS_ACTION_LATENCY] == 1;
+    const TcpRlTraceRecord &applied = pipelined && step > 0 ? m_records[socket.records[step - 1]] : record;
+    m_actionData.push_back (applied.ssThresh);
+    m_actionData.push_back (applied.cWnd);
+    // read in ActionMode Pacing only, in kbit/s like the agent's
+    m_actionData.push_back (static_cast<uint32_t> (std::min<uint64_t> (applied.pacingRate / 1000, 4294967295u)));
+    m_replayNum++;
+  }
+
+  // the action is applied before the next call, the box can be reused
+  if (!m_action || m_actionRowNum != rowNum) {
+    std::vector<uint32_t> shape = {rowNum, 3,};
+    m_action = CreateObject<OpenGymBoxContainer<uint32_t> > (shape);
+    m_actionRowNum = rowNum;
+  }
+  m_action->SetData (m_actionData);
+  Ptr<OpenGymBoxContainer<uint32_t> > action = m_action;
+
+  NS_LOG_INFO ("MyGetAction: " << action);
+  return action;
+}
+
+} // namespace ns3
@@ -0,0 +1,101 @@
+#ifndef TCP_RL_REPLAY_H
+#define TCP_RL_REPLAY_H
+
+#include "tcp-rl-env.h"
+#include "tcp-rl-metrics.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace ns3 {
+
+
+/*
+One agent exchange of one socket: the observation it was sent and the
+action it applied. Written through TcpRlMetricsWriter (fields obs0..obsN),
+so read_metrics in parse_metrics.py reads traces too.
+*/
+struct TcpRlTraceRecord
+{
+  static const uint32_t OBS_CAPACITY = TcpTimeStepGymEnv::m_obsParameterMax;
+
+  double time;
+  uint32_t socketUuid;
+  uint32_t obsNum;
+  uint32_t ssThresh;
+  uint32_t cWnd;
+  uint64_t pacingRate;  // bit/s, 0 outside ActionMode Pacing
+  uint64_t obs[OBS_CAPACITY];
+};
+
+
+// appends the exchanges of all sockets that record into the same file
+class TcpRlTraceRecorder : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlTraceRecorder ();
+  virtual ~TcpRlTraceRecorder ();
+
+  static Ptr<TcpRlTraceRecorder> Get (std::string fileName);
+  static void CloseAll ();
+
+  bool Open (std::string fileName);
+  void Close ();
+  void Record (uint32_t socketUuid, const uint64_t *obs, uint32_t obsNum, uint32_t ssThresh, uint32_t cWnd,
+               uint64_t pacingRate);
+
+private:
+  TcpRlMetricsWriter m_writer;
+  TcpRlTraceRecord m_record;
+};
+
+
+/*
+Answers every observation with the recorded action of the same socket,
+in order, without an agent. The simulation is deterministic, so the
+observations match the trace as long as the scenario and the code do;
+mismatches are counted and reported at Simulator::Destroy.
+Traces recorded with Async applied every action one step late, the
+replay does the same.
+*/
+class TcpRlReplayAgent : public TcpGymLocalAgent
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlReplayAgent ();
+  virtual ~TcpRlReplayAgent ();
+
+  static Ptr<TcpRlReplayAgent> Get (std::string fileName);
+  static void ReportAll ();
+
+  bool Load (std::string fileName);
+  void Report ();
+
+  virtual Ptr<OpenGymDataContainer> GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver);
+
+private:
+  struct SocketTrace
+  {
+    std::vector<uint32_t> records; // indices into m_records
+    uint32_t next {0};
+  };
+
+  std::string m_fileName;
+  std::vector<TcpRlTraceRecord> m_records;
+  std::unordered_map<uint32_t, SocketTrace> m_sockets;
+  uint64_t m_replayNum {0};
+  uint64_t m_mismatchNum {0};
+  uint64_t m_missingNum {0};
+
+  // reused for every action
+  Ptr<OpenGymBoxContainer<uint32_t> > m_action;
+  std::vector<uint32_t> m_actionData;
+  uint32_t m_actionRowNum {0};
+};
+
+} // namespace ns3
+
+#endif /* TCP_RL_REPLAY_H */
@@ -0,0 +1,130 @@
+#include "tcp-rl-reward.h"
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include "ns3/enum.h"
+#include <algorithm>
+#include <cmath>
+
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ns3::TcpRlReward");
+NS_OBJECT_ENSURE_REGISTERED (TcpRlReward);
+
+// keeps the logarithms finite on idle steps
+static const double MIN_THROUGHPUT = 1e-3; // Mbps
+static const double MIN_QUEUE_DELAY = 0.1; // ms
+
+TypeId
+TcpRlReward::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlReward")
+    .SetParent<Object> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpRlReward> ()
+    .AddAttribute ("Utility",
+                   "Utility function of the reward. Default: Legacy (the envs' reward and penalty)",
+                   EnumValue (TcpRlReward::UTILITY_LEGACY),
+                   MakeEnumAccessor (&TcpRlReward::m_utility),
+                   MakeEnumChecker (TcpRlReward::UTILITY_LEGACY, "Legacy",
+                                    TcpRlReward::UTILITY_POWER, "Power",
+                                    TcpRlReward::UTILITY_COPA, "Copa",
+                                    TcpRlReward::UTILITY_VIVACE, "Vivace",
+                                    TcpRlReward::UTILITY_LOG_THROUGHPUT, "LogThroughput"))
+    .AddAttribute ("ThroughputWeight", "Weight of the throughput term. Default: 1",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&TcpRlReward::m_throughputWeight),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("DelayWeight", "Weight of the delay term. Default: 1",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&TcpRlReward::m_delayWeight),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("LossWeight", "Weight of the loss term. Default: 1",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&TcpRlReward::m_lossWeight),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("CopaDelta", "Delay exponent of the Copa utility. Default: 0.5",
+                   DoubleValue (0.5),
+                   MakeDoubleAccessor (&TcpRlReward::m_copaDelta),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("VivaceExponent", "Throughput exponent of the Vivace utility. Default: 0.9",
+                   DoubleValue (0.9),
+                   MakeDoubleAccessor (&TcpRlReward::m_vivaceExponent),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("LatencySlo", "Latency objective of the flow, 0 for none. Default: 0",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&TcpRlReward::m_latencySlo),
+                   MakeTimeChecker ())
+    .AddAttribute ("SloPenalty", "Penalty per relative excess of avgRtt over LatencySlo. Default: 1",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&TcpRlReward::m_sloPenalty),
+                   MakeDoubleChecker<double> (0.0))
+  ;
+
+  return tid;
+}
+
+TcpRlReward::TcpRlReward ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlReward::~TcpRlReward ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlReward::Utility_t
+TcpRlReward::GetUtility () const
+{
+  return m_utility;
+}
+
+bool
+TcpRlReward::IsEnabled () const
+{
+  return m_utility != UTILITY_LEGACY;
+}
+
+double
+TcpRlReward::ComputeUtility (const TcpRlRewardInput &step) const
+{
+  double throughput = step.throughput * 1e-6;
+  double logThroughput = std::log (std::max (throughput, MIN_THROUGHPUT));
+  // without RTT samples the path counts as empty
+  double inflation = step.minRtt > 0 && step.avgRtt > 0 ? step.avgRtt / step.minRtt : 1.0;
+
+  switch (m_utility) {
+    case UTILITY_POWER:
+      return m_throughputWeight * throughput * std::pow (1.0 / inflation, m_delayWeight);
+    case UTILITY_COPA:
+      {
+        double queueDelay = std::max ((step.avgRtt - step.minRtt) * 1e3, MIN_QUEUE_DELAY);
+        return logThroughput - m_copaDelta * std::log (queueDelay);
+      }
+    case UTILITY_VIVACE:
+      return std::pow (throughput, m_vivaceExponent)
+             - m_delayWeight * 900.0 * throughput * std::max (0.0, step.rttGradient)
+             - m_lossWeight * 11.35 * throughput * step.lossRate;
+    case UTILITY_LOG_THROUGHPUT:
+      return m_throughputWeight * logThroughput - m_delayWeight * (inflation - 1.0)
+             - m_lossWeight * step.lossRate;
+    default:
+      return 0.0;
+  }
+}
+
+float
+TcpRlReward::Compute (const TcpRlRewardInput &step)
+{
+  double reward = ComputeUtility (step);
+  double slo = m_latencySlo.GetSeconds ();
+  if (slo > 0 && step.avgRtt > slo) {
+    reward -= m_sloPenalty * (step.avgRtt / slo - 1.0);
+  }
+  NS_LOG_INFO ("Reward: " << reward << " throughput: " << step.throughput << " avgRtt: " << step.avgRtt
+               << " lossRate: " << step.lossRate);
+  return reward;
+}
+
+} // namespace ns3
@@ -0,0 +1,73 @@
+#ifndef TCP_RL_REWARD_H
+#define TCP_RL_REWARD_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+
+namespace ns3 {
+
+
+// what one socket achieved since its previous reward
+struct TcpRlRewardInput
+{
+  double interval;    // s
+  double throughput;  // acked bit/s
+  double avgRtt;      // s, 0 without a sample
+  double minRtt;      // s, 0 without a sample
+  double rttGradient; // change of avgRtt per s
+  double lossRate;    // loss events per acked or lost segment
+};
+
+
+/*
+Reward of the RL envs, computed per socket from the streaming stats of
+the step (time-step envs) or since the previous notification (event
+envs). Throughput is in Mbps, delays relative to minRtt unless noted:
+  Legacy:        the envs' own reward and penalty, nothing is computed here
+  Power:         wT * throughput * (minRtt / avgRtt)^wD
+  Copa:          log(throughput) - delta * log(queueing delay in ms)
+  Vivace:        throughput^exponent - wD * 900 * throughput * max(0, rttGradient)
+                 - wL * 11.35 * throughput * lossRate
+  LogThroughput: wT * log(throughput) - wD * (avgRtt / minRtt - 1) - wL * lossRate
+A LatencySlo subtracts SloPenalty * (avgRtt / LatencySlo - 1) from every
+utility while avgRtt is above it. Subclasses plug in through
+ns3::TcpRlBase::RewardModel.
+*/
+class TcpRlReward : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlReward ();
+  virtual ~TcpRlReward ();
+
+  typedef enum
+  {
+    UTILITY_LEGACY = 0,
+    UTILITY_POWER,
+    UTILITY_COPA,
+    UTILITY_VIVACE,
+    UTILITY_LOG_THROUGHPUT,
+  } Utility_t;
+
+  Utility_t GetUtility () const;
+  // false: the env keeps its built-in reward
+  virtual bool IsEnabled () const;
+  virtual float Compute (const TcpRlRewardInput &step);
+
+protected:
+  double ComputeUtility (const TcpRlRewardInput &step) const;
+
+  Utility_t m_utility;
+  double m_throughputWeight;
+  double m_delayWeight;
+  double m_lossWeight;
+  double m_copaDelta;
+  double m_vivaceExponent;
+  Time m_latencySlo;
+  double m_sloPenalty;
+};
+
+} // namespace ns3
+
+#endif /* TCP_RL_REWARD_H */
@@ -0,0 +1,274 @@
+#include "tcp-rl-shm.h"
+#include "tcp-rl-profiler.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include <map>
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ns3::TcpRlShmAgent");
+NS_OBJECT_ENSURE_REGISTERED (TcpRlShmAgent);
+
+static const uint32_t SLOT_NUM = 16;
+// busy polls before the waiting side starts yielding the CPU,
+// on a single core the agent only runs when we yield
+static const uint32_t SPIN_NUM = 10000;
+// yields between the checks of the agent process
+static const uint32_t CHECK_NUM = 1024;
+
+struct TcpRlShmAgent::Header
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t obsCapacity;
+  uint32_t actionCapacity;
+  uint32_t slotNum;
+  uint32_t closed;
+  uint64_t obsSeq;
+  uint64_t actionSeq;
+  uint32_t agentPid;
+  uint32_t agentClosed;
+  uint32_t rowNum;
+  uint32_t obsWidth;
+  uint32_t actionWidth;
+  uint8_t padding[4];
+};
+
+struct TcpRlShmAgent::ObsRecord
+{
+  uint64_t seq;
+  uint32_t valueNum;
+  float reward;
+  uint32_t gameOver;
+  uint32_t padding;
+  uint64_t values[1];
+};
+
+struct TcpRlShmAgent::ActionRecord
+{
+  uint64_t seq;
+  uint32_t valueNum;
+  uint32_t padding;
+  uint32_t values[2];
+};
+
+static std::map<std::string, Ptr<TcpRlShmAgent> > g_shmAgents;
+
+TypeId
+TcpRlShmAgent::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlShmAgent")
+    .SetParent<TcpGymLocalAgent> ()
+    .SetGroupName ("OpenGym")
+    .AddConstructor<TcpRlShmAgent> ()
+    .AddAttribute ("AgentTimeout",
+                   "Wall clock time one exchange may wait for the agent's action. Default: 0 (none)",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&TcpRlShmAgent::m_agentTimeout),
+                   MakeTimeChecker ())
+  ;
+
+  return tid;
+}
+
+TcpRlShmAgent::TcpRlShmAgent ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlShmAgent::~TcpRlShmAgent ()
+{
+  NS_LOG_FUNCTION (this);
+  Close ();
+}
+
+Ptr<TcpRlShmAgent>
+TcpRlShmAgent::Get (std::string fileName, uint32_t rowNum, uint32_t obsWidth, uint32_t actionWidth)
+{
+  std::map<std::string, Ptr<TcpRlShmAgent> >::iterator it = g_shmAgents.find (fileName);
+  if (it != g_shmAgents.end ()) {
+    Ptr<TcpRlShmAgent> agent = it->second;
+    NS_ABORT_MSG_UNLESS (agent->m_rowNum == rowNum && agent->m_obsWidth == obsWidth && agent->m_actionWidth == actionWidth,
+                         "Sockets of " << fileName << " need the same batch size, FeatureSet and ActionMode");
+    return agent;
+  }
+
+  Ptr<TcpRlShmAgent> agent = CreateObject<TcpRlShmAgent> ();
+  NS_ABORT_MSG_UNLESS (agent->Open (fileName, rowNum, obsWidth, actionWidth, SLOT_NUM),
+                       "Cannot open shared memory file " << fileName);
+  if (g_shmAgents.empty ()) {
+    Simulator::ScheduleDestroy (&TcpRlShmAgent::CloseAll);
+  }
+  g_shmAgents[fileName] = agent;
+  return agent;
+}
+
+void
+TcpRlShmAgent::CloseAll ()
+{
+  for (std::map<std::string, Ptr<TcpRlShmAgent> >::iterator it = g_shmAgents.begin (); it != g_shmAgents.end (); ++it) {
+    if (it->second) {
+      it->second->Close ();
+    }
+  }
+  g_shmAgents.clear ();
+}
+
+bool
+TcpRlShmAgent::Open (std::string fileName, uint32_t rowNum, uint32_t obsWidth, uint32_t actionWidth, uint32_t slotNum)
+{
+  NS_LOG_FUNCTION (this << fileName << rowNum << obsWidth << actionWidth << slotNum);
+  NS_ASSERT (!m_data);
+  static_assert (sizeof (Header) == 64, "Header layout");
+
+  m_fileName = fileName;
+  m_rowNum = rowNum;
+  m_obsWidth = obsWidth;
+  m_actionWidth = actionWidth;
+  m_obsCapacity = rowNum * obsWidth;
+  // keeps action records 8 byte aligned
+  m_actionCapacity = (rowNum * actionWidth + 1) / 2 * 2;
+  m_slotNum = slotNum;
+  m_obsRecordSize = offsetof (ObsRecord, values) + m_obsCapacity * sizeof (uint64_t);
+  m_actionRecordSize = offsetof (ActionRecord, values) + m_actionCapacity * sizeof (uint32_t);
+  m_size = sizeof (Header) + m_slotNum * (m_obsRecordSize + m_actionRecordSize);
+
+  // an agent still attached to an old file must not see this run
+  unlink (fileName.c_str ());
+  int fd = open (fileName.c_str (), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    NS_LOG_ERROR ("Cannot create " << fileName << ": " << std::strerror (errno));
+    return false;
+  }
+  if (ftruncate (fd, m_size) != 0) {
+    NS_LOG_ERROR ("Cannot resize " << fileName << ": " << std::strerror (errno));
+    close (fd);
+    return false;
+  }
+  void *data = mmap (nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED) {
+    NS_LOG_ERROR ("Cannot map " << fileName << ": " << std::strerror (errno));
+    return false;
+  }
+
+  m_data = static_cast<uint8_t *> (data);
+  m_header = reinterpret_cast<Header *> (m_data);
+  m_header->version = 2;
+  m_header->obsCapacity = m_obsCapacity;
+  m_header->actionCapacity = m_actionCapacity;
+  m_header->slotNum = m_slotNum;
+  m_header->closed = 0;
+  m_header->obsSeq = 0;
+  m_header->actionSeq = 0;
+  m_header->agentPid = 0;
+  m_header->agentClosed = 0;
+  m_header->rowNum = m_rowNum;
+  m_header->obsWidth = m_obsWidth;
+  m_header->actionWidth = m_actionWidth;
+  m_seq = 0;
+  // the agent starts reading once the magic is there
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  std::memcpy (m_header->magic, "TRLS", sizeof (m_header->magic));
+
+  NS_LOG_INFO ("Opened shared memory transport " << fileName << " size: " << m_size);
+  return true;
+}
+
+void
+TcpRlShmAgent::Close ()
+{
+  NS_LOG_FUNCTION (this);
+  if (!m_data) {
+    return;
+  }
+  __atomic_store_n (&m_header->closed, 1, __ATOMIC_RELEASE);
+  munmap (m_data, m_size);
+  unlink (m_fileName.c_str ());
+  m_data = nullptr;
+  m_header = nullptr;
+}
+
+TcpRlShmAgent::ObsRecord *
+TcpRlShmAgent::GetObsRecord (uint64_t seq)
+{
+  uint8_t *ring = m_data + sizeof (Header);
+  return reinterpret_cast<ObsRecord *> (ring + ((seq - 1) % m_slotNum) * m_obsRecordSize);
+}
+
+TcpRlShmAgent::ActionRecord *
+TcpRlShmAgent::GetActionRecord (uint64_t seq)
+{
+  uint8_t *ring = m_data + sizeof (Header) + m_slotNum * m_obsRecordSize;
+  return reinterpret_cast<ActionRecord *> (ring + ((seq - 1) % m_slotNum) * m_actionRecordSize);
+}
+
+void
+TcpRlShmAgent::CheckAgent (uint64_t waited)
+{
+  NS_ABORT_MSG_IF (__atomic_load_n (&m_header->agentClosed, __ATOMIC_ACQUIRE),
+                   "Agent detached from shared memory file " << m_fileName);
+  pid_t pid = __atomic_load_n (&m_header->agentPid, __ATOMIC_ACQUIRE);
+  NS_ABORT_MSG_IF (pid > 0 && kill (pid, 0) != 0 && errno == ESRCH,
+                   "Agent process " << pid << " of " << m_fileName << " exited");
+  NS_ABORT_MSG_IF (m_agentTimeout.IsStrictlyPositive () && waited > static_cast<uint64_t> (m_agentTimeout.GetNanoSeconds ()),
+                   "No action from the agent of " << m_fileName << " within " << m_agentTimeout.GetSeconds () << "s");
+}
+
+Ptr<OpenGymDataContainer>
+TcpRlShmAgent::GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT_MSG (m_data, "Shared memory transport is closed");
+  Ptr<OpenGymBoxContainer<uint64_t> > obsBox = DynamicCast<OpenGymBoxContainer<uint64_t> > (obs);
+  NS_ASSERT_MSG (obsBox, "Only uint64 observations go through shared memory");
+  const std::vector<uint64_t> &data = obsBox->GetData ();
+  NS_ABORT_MSG_IF (data.size () > m_obsCapacity, "Observation has more than " << m_obsCapacity << " values");
+
+  uint64_t seq = ++m_seq;
+  ObsRecord *record = GetObsRecord (seq);
+  record->seq = seq;
+  record->valueNum = data.size ();
+  record->reward = reward;
+  record->gameOver = gameOver;
+  std::copy (data.begin (), data.end (), record->values);
+  __atomic_store_n (&m_header->obsSeq, seq, __ATOMIC_RELEASE);
+
+  static const uint32_t spinNum = std::thread::hardware_concurrency () > 1 ? SPIN_NUM : 0;
+  uint32_t spins = 0;
+  uint64_t start = TcpRlProfiler::GetWallTime ();
+  while (__atomic_load_n (&m_header->actionSeq, __ATOMIC_ACQUIRE) < seq) {
+    if (++spins > spinNum) {
+      std::this_thread::yield ();
+      if ((spins - spinNum) % CHECK_NUM == 0) {
+        CheckAgent (TcpRlProfiler::GetWallTime () - start);
+      }
+    }
+  }
+
+  ActionRecord *actionRecord = GetActionRecord (seq);
+  NS_ABORT_MSG_UNLESS (actionRecord->seq == seq && actionRecord->valueNum <= m_actionCapacity,
+                       "Bad action record " << actionRecord->seq << " for observation " << seq);
+  // the action is applied before the next exchange, the box can be reused
+  if (!m_action || m_actionData.size () != actionRecord->valueNum) {
+    std::vector<uint32_t> shape = {actionRecord->valueNum,};
+    m_action = CreateObject<OpenGymBoxContainer<uint32_t> > (shape);
+  }
+  m_actionData.assign (actionRecord->values, actionRecord->values + actionRecord->valueNum);
+  m_action->SetData (m_actionData);
+  Ptr<OpenGymBoxContainer<uint32_t> > action = m_action;
+
+  NS_LOG_INFO ("MyGetAction: " << action);
+  return action;
+}
+
+} // namespace ns3
@@ -0,0 +1,99 @@
+#ifndef TCP_RL_SHM_H
+#define TCP_RL_SHM_H
+
+#include "tcp-rl-env.h"
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+
+/*
+Exchanges observations and actions with the agent through a memory-mapped
+file instead of the OpenGymInterface ZMQ socket (see ShmEnv in tcp_base.py).
+The simulator blocks on every exchange, like Notify.
+
+File layout, little endian, records are 8 byte aligned:
+  header, 64 bytes:
+    char[4]  magic "TRLS"
+    uint32   version (2)
+    uint32   obs capacity, uint64 values per observation record
+    uint32   action capacity, uint32 values per action record
+    uint32   slot num, records per ring
+    uint32   closed, set when the simulation ends
+    uint64   obs seq, observation records written by the simulator
+    uint64   action seq, action records written by the agent
+    uint32   agent pid, written by the agent when it attaches
+    uint32   agent closed, set when the agent detaches
+    uint32   row num, sockets per record (the batch size)
+    uint32   obs width, observation values per row
+    uint32   action width, action values per row
+  observation ring, slot num records:
+    uint64   seq
+    uint32   value num
+    float    reward
+    uint32   game over
+    uint32   padding
+    uint64   values[obs capacity]
+  action ring, slot num records:
+    uint64   seq, the seq of the observation it answers
+    uint32   value num
+    uint32   padding
+    uint32   values[action capacity], Absolute or Pacing actions only
+The capacities are row num times the widths, rounded up to an even number
+for actions. Record n (from 1) lives in slot (n - 1) % slot num. A writer fills the
+record first and publishes it by storing its seq in the header. The
+simulator aborts a wait when the agent detached, its process is gone or
+AgentTimeout passed.
+*/
+class TcpRlShmAgent : public TcpGymLocalAgent
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlShmAgent ();
+  virtual ~TcpRlShmAgent ();
+
+  // sockets that use the same file share one transport, and its row shape
+  static Ptr<TcpRlShmAgent> Get (std::string fileName, uint32_t rowNum, uint32_t obsWidth, uint32_t actionWidth);
+
+  bool Open (std::string fileName, uint32_t rowNum, uint32_t obsWidth, uint32_t actionWidth, uint32_t slotNum);
+  // tells the agent the simulation is over and removes the file
+  void Close ();
+  static void CloseAll ();
+
+  virtual Ptr<OpenGymDataContainer> GetAction (Ptr<OpenGymDataContainer> obs, float reward, bool gameOver);
+
+private:
+  struct Header;
+  struct ObsRecord;
+  struct ActionRecord;
+
+  ObsRecord *GetObsRecord (uint64_t seq);
+  ActionRecord *GetActionRecord (uint64_t seq);
+  // aborts once the agent cannot answer anymore, waited: ns since the exchange started
+  void CheckAgent (uint64_t waited);
+
+  std::string m_fileName;
+  uint8_t *m_data {nullptr};
+  size_t m_size {0};
+  Header *m_header {nullptr};
+  uint32_t m_rowNum {0};
+  uint32_t m_obsWidth {0};
+  uint32_t m_actionWidth {0};
+  uint32_t m_obsCapacity {0};
+  uint32_t m_actionCapacity {0};
+  uint32_t m_slotNum {0};
+  size_t m_obsRecordSize {0};
+  size_t m_actionRecordSize {0};
+  uint64_t m_seq {0};
+  Time m_agentTimeout;
+
+  // reused for every action
+  Ptr<OpenGymBoxContainer<uint32_t> > m_action;
+  std::vector<uint32_t> m_actionData;
+};
+
+} // namespace ns3
+
+#endif /* TCP_RL_SHM_H */
@@ -0,0 +1,158 @@
+#include "tcp-rl-stats.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ns3 {
+
+TcpRlStreamStats::TcpRlStreamStats ()
+{
+  Reset ();
+}
+
+void
+TcpRlStreamStats::Add (uint64_t value)
+{
+  m_count++;
+  m_sum += value;
+  m_min = std::min (m_min, value);
+  m_max = std::max (m_max, value);
+
+  double delta = value - m_mean;
+  m_mean += delta / m_count;
+  m_m2 += delta * (value - m_mean);
+}
+
+void
+TcpRlStreamStats::Reset ()
+{
+  m_count = 0;
+  m_sum = 0;
+  m_min = std::numeric_limits<uint64_t>::max ();
+  m_max = 0;
+  m_mean = 0.0;
+  m_m2 = 0.0;
+}
+
+uint64_t
+TcpRlStreamStats::GetCount () const
+{
+  return m_count;
+}
+
+uint64_t
+TcpRlStreamStats::GetSum () const
+{
+  return m_sum;
+}
+
+uint64_t
+TcpRlStreamStats::GetMin () const
+{
+  return m_count ? m_min : 0;
+}
+
+uint64_t
+TcpRlStreamStats::GetMax () const
+{
+  return m_max;
+}
+
+double
+TcpRlStreamStats::GetMean () const
+{
+  return m_mean;
+}
+
+double
+TcpRlStreamStats::GetVariance () const
+{
+  if (m_count < 2) {
+    return 0.0;
+  }
+  return m_m2 / m_count;
+}
+
+
+static const uint32_t SUB_BUCKET_NUM = 1 << TcpRlLogHistogram::SUB_BUCKET_BITS;
+
+TcpRlLogHistogram::TcpRlLogHistogram ()
+  : m_counts ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_NUM, 0),
+    m_count (0),
+    m_min (std::numeric_limits<uint64_t>::max ()),
+    m_max (0),
+    m_maxIndex (0)
+{
+}
+
+uint32_t
+TcpRlLogHistogram::GetIndex (uint64_t value)
+{
+  if (value < SUB_BUCKET_NUM) {
+    return value;
+  }
+  uint32_t msb = 63 - __builtin_clzll (value);
+  uint32_t shift = msb - SUB_BUCKET_BITS;
+  // top SUB_BUCKET_BITS + 1 bits of the value select the bucket
+  return (shift + 1) * SUB_BUCKET_NUM + (value >> shift) - SUB_BUCKET_NUM;
+}
+
+uint64_t
+TcpRlLogHistogram::GetValue (uint32_t index)
+{
+  if (index < 2 * SUB_BUCKET_NUM) {
+    return index;
+  }
+  uint32_t shift = index / SUB_BUCKET_NUM - 1;
+  uint64_t lower = static_cast<uint64_t> (SUB_BUCKET_NUM + index % SUB_BUCKET_NUM) << shift;
+  return lower + ((static_cast<uint64_t> (1) << shift) >> 1);
+}
+
+void
+TcpRlLogHistogram::Add (uint64_t value)
+{
+  uint32_t index = GetIndex (value);
+  m_counts[index]++;
+  m_maxIndex = std::max (m_maxIndex, index);
+  m_count++;
+  m_min = std::min (m_min, value);
+  m_max = std::max (m_max, value);
+}
+
+void
+TcpRlLogHistogram::Reset ()
+{
+  if (m_count) {
+    std::fill (m_counts.begin (), m_counts.begin () + m_maxIndex + 1, 0);
+  }
+  m_count = 0;
+  m_min = std::numeric_limits<uint64_t>::max ();
+  m_max = 0;
+  m_maxIndex = 0;
+}
+
+uint64_t
+TcpRlLogHistogram::GetCount () const
+{
+  return m_count;
+}
+
+uint64_t
+TcpRlLogHistogram::GetPercentile (double q) const
+{
+  if (!m_count) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t> (1, std::ceil (q * m_count));
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i <= m_maxIndex; i++) {
+    seen += m_counts[i];
+    if (seen >= rank) {
+      // the exact extremes are known, keep the estimate inside them
+      return std::min (std::max (GetValue (i), m_min), m_max);
+    }
+  }
+  return m_max;
+}
+
+} // namespace ns3
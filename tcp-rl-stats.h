@@ -0,0 +1,74 @@
+#ifndef TCP_RL_STATS_H
+#define TCP_RL_STATS_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace ns3 {
+
+
+/*
+Per-step statistics of a stream of samples in constant memory:
+count, sum, min, max and Welford mean/variance.
+*/
+class TcpRlStreamStats
+{
+public:
+  TcpRlStreamStats ();
+
+  void Add (uint64_t value);
+  void Reset ();
+
+  uint64_t GetCount () const;
+  uint64_t GetSum () const;
+  uint64_t GetMin () const;
+  uint64_t GetMax () const;
+  double GetMean () const;
+  // population variance, 0 with less than two samples
+  double GetVariance () const;
+
+private:
+  uint64_t m_count;
+  uint64_t m_sum;
+  uint64_t m_min;
+  uint64_t m_max;
+  double m_mean;
+  double m_m2;
+};
+
+
+/*
+Log-bucket (HDR style) histogram: values below 2^SUB_BUCKET_BITS are exact,
+above that every power of two is split into 2^SUB_BUCKET_BITS buckets,
+so percentiles are within ~6% of the sample without storing samples.
+*/
+class TcpRlLogHistogram
+{
+public:
+  TcpRlLogHistogram ();
+
+  void Add (uint64_t value);
+  void Reset ();
+
+  uint64_t GetCount () const;
+  // q in [0, 1], 0 without samples
+  uint64_t GetPercentile (double q) const;
+
+  static const uint32_t SUB_BUCKET_BITS = 4;
+
+private:
+  static uint32_t GetIndex (uint64_t value);
+  // midpoint of the bucket
+  static uint64_t GetValue (uint32_t index);
+
+  std::vector<uint32_t> m_counts;
+  uint64_t m_count;
+  uint64_t m_min;
+  uint64_t m_max;
+  // buckets above it are empty, bounds Reset and GetPercentile
+  uint32_t m_maxIndex;
+};
+
+} // namespace ns3
+
+#endif /* TCP_RL_STATS_H */
@@ -1,13 +1,24 @@
 #include "tcp-rl.h"
 #include "tcp-rl-env.h"
+#include "tcp-rl-policy.h"
+#include "tcp-rl-shm.h"
+#include "tcp-rl-profiler.h"
+#include "tcp-rl-replay.h"
+#include "tcp-rl-dataset.h"
+#include "tcp-rl-reward.h"
 #include "ns3/tcp-header.h"
 #include "ns3/object.h"
-#include "ns3/node-list.h"
 #include "ns3/core-module.h"
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 #include "ns3/tcp-socket-base.h"
 #include "ns3/tcp-l4-protocol.h"
+#include "ns3/tcp-recovery-ops.h"
+#include "ns3/rtt-estimator.h"
+#include "ns3/node-list.h"
+#include "ns3/enum.h"
+#include "ns3/pointer.h"
+#include <unordered_map>
 
 
 namespace ns3 {
@@ -32,8 +43,23 @@ TcpSocketDerived::GetInstanceTypeId () const
   return TcpSocketDerived::GetTypeId ();
 }
 
+// TcpSocketState -> socket, filled by the socket constructors
+static std::unordered_map<const TcpSocketState *, TcpSocketDerived *> &
+GetSocketRegistry (void)
+{
+  static std::unordered_map<const TcpSocketState *, TcpSocketDerived *> registry;
+  return registry;
+}
+
 TcpSocketDerived::TcpSocketDerived (void)
 {
+  GetSocketRegistry ()[PeekPointer (m_tcb)] = this;
+}
+
+TcpSocketDerived::TcpSocketDerived (const TcpSocketDerived& sock)
+  : TcpSocketBase (sock)
+{
+  GetSocketRegistry ()[PeekPointer (m_tcb)] = this;
 }
 
 Ptr<TcpCongestionOps>
@@ -42,8 +68,146 @@ TcpSocketDerived::GetCongestionControlAlgorithm ()
   return m_congestionControl;
 }
 
+uint32_t
+TcpSocketDerived::GetCongestionWindow () const
+{
+  return m_tcb->m_cWnd;
+}
+
+Ptr<TcpSocketState>
+TcpSocketDerived::GetTcb () const
+{
+  return m_tcb;
+}
+
+Ptr<TcpSocketDerived>
+TcpSocketDerived::LookupSocket (Ptr<const TcpSocketState> tcb)
+{
+  std::unordered_map<const TcpSocketState *, TcpSocketDerived *>::const_iterator it =
+    GetSocketRegistry ().find (PeekPointer (tcb));
+  if (it == GetSocketRegistry ().end ()) {
+    return 0;
+  }
+  return it->second;
+}
+
+// address:port -> socket, rebuilt from the registry on a miss
+struct SocketAddressIndex
+{
+  std::unordered_map<uint64_t, TcpSocketDerived *> sockets;
+  Time built {Seconds (-1)};
+};
+
+static SocketAddressIndex &
+GetSocketAddressIndex (void)
+{
+  static SocketAddressIndex index;
+  return index;
+}
+
+static uint64_t
+GetAddressKey (Ipv4Address address, uint16_t port)
+{
+  return (static_cast<uint64_t> (address.Get ()) << 16) | port;
+}
+
+Ptr<TcpSocketDerived>
+TcpSocketDerived::LookupSocket (Ipv4Address address, uint16_t port)
+{
+  SocketAddressIndex &index = GetSocketAddressIndex ();
+  uint64_t key = GetAddressKey (address, port);
+  std::unordered_map<uint64_t, TcpSocketDerived *>::const_iterator found = index.sockets.find (key);
+  // one scan per simulated instant, thousands of flows are resolved at once
+  if (found == index.sockets.end () && index.built != Simulator::Now ()) {
+    index.sockets.clear ();
+    index.built = Simulator::Now ();
+    std::unordered_map<const TcpSocketState *, TcpSocketDerived *>::const_iterator it;
+    for (it = GetSocketRegistry ().begin (); it != GetSocketRegistry ().end (); ++it) {
+      Address name;
+      if (it->second->GetSockName (name) != 0 || !InetSocketAddress::IsMatchingType (name)) {
+        continue;
+      }
+      InetSocketAddress local = InetSocketAddress::ConvertFrom (name);
+      // the first socket bound to an address wins
+      index.sockets.emplace (GetAddressKey (local.GetIpv4 (), local.GetPort ()), it->second);
+    }
+    found = index.sockets.find (key);
+  }
+  if (found == index.sockets.end ()) {
+    return 0;
+  }
+  return found->second;
+}
+
+Ptr<TcpSocketBase>
+TcpSocketDerived::Fork (void)
+{
+  return CopyObject<TcpSocketDerived> (this);
+}
+
 TcpSocketDerived::~TcpSocketDerived (void)
 {
+  GetSocketRegistry ().erase (PeekPointer (m_tcb));
+  // the index may hold this socket, the next lookup rebuilds it
+  SocketAddressIndex &index = GetSocketAddressIndex ();
+  if (!index.sockets.empty ()) {
+    index.sockets.clear ();
+  }
+  index.built = Seconds (-1);
+}
+
+
+NS_OBJECT_ENSURE_REGISTERED (TcpSocketDerivedFactory);
+
+TypeId
+TcpSocketDerivedFactory::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpSocketDerivedFactory")
+    .SetParent<SocketFactory> ()
+    .SetGroupName ("Internet")
+    .AddConstructor<TcpSocketDerivedFactory> ()
+  ;
+  return tid;
+}
+
+void
+TcpSocketDerivedFactory::InstallAll (void)
+{
+  for (NodeList::Iterator it = NodeList::Begin (); it != NodeList::End (); ++it) {
+    if ((*it)->GetObject<TcpL4Protocol> () && !(*it)->GetObject<TcpSocketDerivedFactory> ()) {
+      (*it)->AggregateObject (CreateObject<TcpSocketDerivedFactory> ());
+    }
+  }
+}
+
+Ptr<Socket>
+TcpSocketDerivedFactory::CreateSocket (void)
+{
+  Ptr<Node> node = GetObject<Node> ();
+  Ptr<TcpL4Protocol> tcp = GetObject<TcpL4Protocol> ();
+  NS_ABORT_MSG_UNLESS (node && tcp, "TcpSocketDerivedFactory needs a node with a TCP stack");
+
+  // the same parts TcpL4Protocol::CreateSocket puts together
+  TypeIdValue rttType;
+  TypeIdValue congestionType;
+  TypeIdValue recoveryType;
+  tcp->GetAttribute ("RttEstimatorType", rttType);
+  tcp->GetAttribute ("SocketType", congestionType);
+  tcp->GetAttribute ("RecoveryType", recoveryType);
+
+  ObjectFactory factory;
+  Ptr<TcpSocketDerived> socket = CreateObject<TcpSocketDerived> ();
+  socket->SetNode (node);
+  socket->SetTcp (tcp);
+  factory.SetTypeId (rttType.Get ());
+  socket->SetRtt (factory.Create<RttEstimator> ());
+  factory.SetTypeId (congestionType.Get ());
+  socket->SetCongestionControlAlgorithm (factory.Create<TcpCongestionOps> ());
+  factory.SetTypeId (recoveryType.Get ());
+  socket->SetRecoveryAlgorithm (factory.Create<TcpRecoveryOps> ());
+  // the protocol owns its sockets, they show up in its SocketList
+  tcp->AddSocket (socket);
+  return socket;
 }
 
 
@@ -57,6 +221,88 @@ TcpRlBase::GetTypeId (void)
     .SetParent<TcpCongestionOps> ()
     .SetGroupName ("Internet")
     .AddConstructor<TcpRlBase> ()
+    .AddAttribute ("ShmFile",
+                   "Exchange with the agent through this memory-mapped file instead of OpenGymInterface. Default: \"\" (ZMQ)",
+                   StringValue (""),
+                   MakeStringAccessor (&TcpRlBase::m_shmFile),
+                   MakeStringChecker ())
+    .AddAttribute ("LocalAgent",
+                   "Computes the actions in-process instead of the agent, e.g. a TcpRlNewRenoAgent. Default: none",
+                   PointerValue (),
+                   MakePointerAccessor (&TcpRlBase::m_localAgent),
+                   MakePointerChecker<TcpGymLocalAgent> ())
+    .AddAttribute ("RecordFile",
+                   "Append every agent exchange of the socket to this trace. Default: \"\" (off)",
+                   StringValue (""),
+                   MakeStringAccessor (&TcpRlBase::m_recordFile),
+                   MakeStringChecker ())
+    .AddAttribute ("ReplayFile",
+                   "Apply the actions of this trace instead of asking the agent. Default: \"\" (off)",
+                   StringValue (""),
+                   MakeStringAccessor (&TcpRlBase::m_replayFile),
+                   MakeStringChecker ())
+    .AddAttribute ("FeatureSet",
+                   "Observation features that are computed and sent, each set extends the previous one. Default: Full",
+                   EnumValue (TcpGymEnv::FEATURES_FULL),
+                   MakeEnumAccessor (&TcpRlBase::m_featureSet),
+                   MakeEnumChecker (TcpGymEnv::FEATURES_MINIMAL, "Minimal",
+                                    TcpGymEnv::FEATURES_BASIC, "Basic",
+                                    TcpGymEnv::FEATURES_FULL, "Full",
+                                    TcpGymEnv::FEATURES_EXTENDED, "Extended"))
+    .AddAttribute ("ActionMode",
+                   "How the agent's actions are read: absolute windows, window changes in segments, "
+                   "window factors, absolute windows and a pacing rate in kbit/s, windows in segments "
+                   "or log2 of the windows. Default: Absolute",
+                   EnumValue (TcpGymEnv::ACTION_ABSOLUTE),
+                   MakeEnumAccessor (&TcpRlBase::m_actionMode),
+                   MakeEnumChecker (TcpGymEnv::ACTION_ABSOLUTE, "Absolute",
+                                    TcpGymEnv::ACTION_ADDITIVE, "Additive",
+                                    TcpGymEnv::ACTION_MULTIPLICATIVE, "Multiplicative",
+                                    TcpGymEnv::ACTION_PACING, "Pacing",
+                                    TcpGymEnv::ACTION_SEGMENTS, "Segments",
+                                    TcpGymEnv::ACTION_LOG2, "Log2"))
+    .AddAttribute ("Fallback",
+                   "Congestion control that sets the window until the agent's first action and after "
+                   "a late or out of bounds one, e.g. TcpCubic or TcpBbr. Default: TcpNewReno",
+                   TypeIdValue (TcpNewReno::GetTypeId ()),
+                   MakeTypeIdAccessor (&TcpRlBase::m_fallbackType),
+                   MakeTypeIdChecker ())
+    .AddAttribute ("ActionDeadline",
+                   "Wall clock time the agent has for one exchange, later actions are dropped. Default: 0 (none)",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&TcpRlBase::m_actionDeadline),
+                   MakeTimeChecker ())
+    .AddAttribute ("CwndCollapse",
+                   "End the socket's episode when cWnd stays below this many segments. Default: 0 (off)",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&TcpRlBase::m_cwndCollapse),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("ZeroGoodputStop",
+                   "End the socket's episode when no segment is acked. Default: false",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&TcpRlBase::m_zeroGoodputStop),
+                   MakeBooleanChecker ())
+    .AddAttribute ("RttLimit",
+                   "End the socket's episode when the RTT stays above this many times minRtt. Default: 0 (off)",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&TcpRlBase::m_rttLimit),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("TerminationPatience",
+                   "How long an early termination condition has to hold. Default: 1s",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&TcpRlBase::m_terminationPatience),
+                   MakeTimeChecker ())
+    .AddAttribute ("RewardModel",
+                   "Reward model created per socket, its Utility Legacy keeps the env's reward. "
+                   "Default: TcpRlReward",
+                   TypeIdValue (TcpRlReward::GetTypeId ()),
+                   MakeTypeIdAccessor (&TcpRlBase::m_rewardType),
+                   MakeTypeIdChecker ())
+    .AddAttribute ("LatencySlo",
+                   "Latency objective of this flow, overrides the reward model's LatencySlo. Default: 0 (model's)",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&TcpRlBase::m_latencySlo),
+                   MakeTimeChecker ())
   ;
   return tid;
 }
@@ -70,7 +316,21 @@ TcpRlBase::TcpRlBase (void)
 }
 
 TcpRlBase::TcpRlBase (const TcpRlBase& sock)
-  : TcpCongestionOps (sock)
+  : TcpCongestionOps (sock),
+    m_shmFile (sock.m_shmFile),
+    m_localAgent (sock.m_localAgent),
+    m_recordFile (sock.m_recordFile),
+    m_replayFile (sock.m_replayFile),
+    m_featureSet (sock.m_featureSet),
+    m_actionMode (sock.m_actionMode),
+    m_fallbackType (sock.m_fallbackType),
+    m_actionDeadline (sock.m_actionDeadline),
+    m_cwndCollapse (sock.m_cwndCollapse),
+    m_zeroGoodputStop (sock.m_zeroGoodputStop),
+    m_rttLimit (sock.m_rttLimit),
+    m_terminationPatience (sock.m_terminationPatience),
+    m_rewardType (sock.m_rewardType),
+    m_latencySlo (sock.m_latencySlo)
 {
   NS_LOG_FUNCTION (this);
   m_tcpSocket = 0;
@@ -81,6 +341,7 @@ TcpRlBase::~TcpRlBase (void)
 {
   m_tcpSocket = 0;
   m_tcpGymEnv = 0;
+  m_fallback = 0;
 }
 
 uint64_t
@@ -102,49 +363,66 @@ void
 TcpRlBase::ConnectSocketCallbacks()
 {
   NS_LOG_FUNCTION (this);
+  NS_LOG_DEBUG("Connect socket callbacks " << m_tcpSocket->GetNode()->GetId());
+  m_tcpSocket->TraceConnectWithoutContext ("Tx", MakeCallback (&TcpGymEnv::TxPktTrace, m_tcpGymEnv));
+  m_tcpSocket->TraceConnectWithoutContext ("Rx", MakeCallback (&TcpGymEnv::RxPktTrace, m_tcpGymEnv));
+  m_tcpGymEnv->SetNodeId(m_tcpSocket->GetNode()->GetId());
+}
 
-  bool foundSocket = false;
-  for (NodeList::Iterator i = NodeList::Begin (); i != NodeList::End (); ++i) {
-    Ptr<Node> node = *i;
-    Ptr<TcpL4Protocol> tcp = node->GetObject<TcpL4Protocol> ();
-
-    ObjectVectorValue socketVec;
-    tcp->GetAttribute ("SocketList", socketVec);
-    NS_LOG_DEBUG("Node: " << node->GetId() << " TCP socket num: " << socketVec.GetN());
-
-    uint32_t sockNum = socketVec.GetN();
-    for (uint32_t j=0; j<sockNum; j++) {
-      Ptr<Object> sockObj = socketVec.Get(j);
-      Ptr<TcpSocketBase> tcpSocket = DynamicCast<TcpSocketBase> (sockObj);
-      NS_LOG_DEBUG("Node: " << node->GetId() << " TCP Socket: " << tcpSocket);
-      if(!tcpSocket) { continue; }
-
-      Ptr<TcpSocketDerived> dtcpSocket = StaticCast<TcpSocketDerived>(tcpSocket);
-      Ptr<TcpCongestionOps> ca = dtcpSocket->GetCongestionControlAlgorithm();
-      NS_LOG_DEBUG("CA name: " << ca->GetName());
-      Ptr<TcpRlBase> rlCa = DynamicCast<TcpRlBase>(ca);
-      if (rlCa == this) {
-        NS_LOG_DEBUG("Found TcpRl CA!");
-        foundSocket = true;
-        m_tcpSocket = tcpSocket;
-        break;
-      }
-    }
-
-    if (foundSocket) {
-      break;
+void
+TcpRlBase::Init (Ptr<TcpSocketState> tcb)
+{
+  NS_LOG_FUNCTION (this << tcb);
+  m_tcpSocket = TcpSocketDerived::LookupSocket (tcb);
+  NS_ABORT_MSG_UNLESS (m_tcpSocket, "TCP socket was not found, create it with ns3::TcpSocketDerivedFactory.");
+  CreateGymEnv();
+  if (m_tcpGymEnv) {
+    m_tcpGymEnv->SetFeatureSet(m_featureSet);
+    m_tcpGymEnv->SetActionMode(m_actionMode);
+    m_tcpGymEnv->SetActionDeadline(m_actionDeadline);
+    m_tcpGymEnv->SetCwndCollapse(m_cwndCollapse);
+    m_tcpGymEnv->SetZeroGoodputStop(m_zeroGoodputStop);
+    m_tcpGymEnv->SetRttLimit(m_rttLimit);
+    m_tcpGymEnv->SetTerminationPatience(m_terminationPatience);
+
+    ObjectFactory rewardFactory;
+    rewardFactory.SetTypeId (m_rewardType);
+    if (m_latencySlo.IsStrictlyPositive ()) {
+      rewardFactory.Set ("LatencySlo", TimeValue (m_latencySlo));
     }
+    m_tcpGymEnv->SetRewardModel(rewardFactory.Create<TcpRlReward> ());
+  }
+  if (m_tcpGymEnv && !m_recordFile.empty ()) {
+    m_tcpGymEnv->SetRecorder(TcpRlTraceRecorder::Get(m_recordFile));
+  }
+  if (m_tcpGymEnv && !m_replayFile.empty ()) {
+    m_tcpGymEnv->SetLocalAgent(TcpRlReplayAgent::Get(m_replayFile));
+  } else if (m_tcpGymEnv && m_localAgent) {
+    m_tcpGymEnv->SetLocalAgent(m_localAgent);
+  } else if (m_tcpGymEnv && !m_shmFile.empty ()) {
+    // the action ring carries uint32 values, relative and segment actions would be read as bytes
+    NS_ABORT_MSG_UNLESS (m_actionMode == TcpGymEnv::ACTION_ABSOLUTE || m_actionMode == TcpGymEnv::ACTION_PACING,
+                         "ShmFile only carries the Absolute and Pacing ActionModes");
+    m_tcpGymEnv->SetLocalAgent(TcpRlShmAgent::Get(m_shmFile, GetAgentRowNum (), m_tcpGymEnv->GetObsRowSize (),
+                                                  TcpGymEnv::GetActionRowSize (m_actionMode)));
   }
 
-  NS_ASSERT_MSG(m_tcpSocket, "TCP socket was not found.");
+  ObjectFactory factory;
+  factory.SetTypeId (m_fallbackType);
+  m_fallback = factory.Create<TcpCongestionOps> ();
+  m_fallback->Init (tcb);
+}
 
-  if(m_tcpSocket) {
-    NS_LOG_DEBUG("Found TCP Socket: " << m_tcpSocket);
-    m_tcpSocket->TraceConnectWithoutContext ("Tx", MakeCallback (&TcpGymEnv::TxPktTrace, m_tcpGymEnv));
-    m_tcpSocket->TraceConnectWithoutContext ("Rx", MakeCallback (&TcpGymEnv::RxPktTrace, m_tcpGymEnv));
-    NS_LOG_DEBUG("Connect socket callbacks " << m_tcpSocket->GetNode()->GetId());
-    m_tcpGymEnv->SetNodeId(m_tcpSocket->GetNode()->GetId());
-  }
+uint32_t
+TcpRlBase::GetAgentRowNum () const
+{
+  return 1;
+}
+
+bool
+TcpRlBase::AgentDrives () const
+{
+  return m_tcpGymEnv && m_tcpGymEnv->HasAgentAction ();
 }
 
 std::string
@@ -153,20 +431,39 @@ TcpRlBase::GetName () const
   return "TcpRlBase";
 }
 
+uint32_t
+TcpRlBase::GetSocketUuid () const
+{
+  if (!m_tcpGymEnv) {
+    return 0;
+  }
+  return m_tcpGymEnv->GetSocketUuid ();
+}
+
+Ptr<TcpGymEnv>
+TcpRlBase::GetGymEnv () const
+{
+  return m_tcpGymEnv;
+}
+
 uint32_t
 TcpRlBase::GetSsThresh (Ptr<const TcpSocketState> state,
                          uint32_t bytesInFlight)
 {
   NS_LOG_FUNCTION (this << state << bytesInFlight);
-
-  if (!m_tcpGymEnv) {
-    CreateGymEnv();
-  }
+  TcpRlProfiler::Scope scope (TcpRlProfiler::GET_SS_THRESH);
 
   uint32_t newSsThresh = 0;
   if (m_tcpGymEnv) {
       newSsThresh = m_tcpGymEnv->GetSsThresh(state, bytesInFlight);
   }
+  if (m_fallback) {
+      // asked even when unused, stateful delegates (TcpCubic) track losses here
+      uint32_t fallbackSsThresh = m_fallback->GetSsThresh(state, bytesInFlight);
+      if (!AgentDrives()) {
+        newSsThresh = fallbackSsThresh;
+      }
+  }
 
   return newSsThresh;
 }
@@ -175,55 +472,81 @@ void
 TcpRlBase::IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked)
 {
   NS_LOG_FUNCTION (this << tcb << segmentsAcked);
-
-  if (!m_tcpGymEnv) {
-    CreateGymEnv();
-  }
+  TcpRlProfiler::Scope scope (TcpRlProfiler::INCREASE_WINDOW);
 
   if (m_tcpGymEnv) {
      m_tcpGymEnv->IncreaseWindow(tcb, segmentsAcked);
   }
+  if (m_fallback && !AgentDrives()) {
+     m_fallback->IncreaseWindow(tcb, segmentsAcked);
+  }
 }
 
 void
 TcpRlBase::PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time& rtt)
 {
   NS_LOG_FUNCTION (this);
-
-  if (!m_tcpGymEnv) {
-    CreateGymEnv();
-  }
+  TcpRlProfiler::Scope scope (TcpRlProfiler::PKTS_ACKED);
 
   if (m_tcpGymEnv) {
      m_tcpGymEnv->PktsAcked(tcb, segmentsAcked, rtt);
   }
+  if (m_fallback) {
+     m_fallback->PktsAcked(tcb, segmentsAcked, rtt);
+  }
 }
 
 void
 TcpRlBase::CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState)
 {
   NS_LOG_FUNCTION (this);
-
-  if (!m_tcpGymEnv) {
-    CreateGymEnv();
-  }
+  TcpRlProfiler::Scope scope (TcpRlProfiler::CONGESTION_STATE_SET);
 
   if (m_tcpGymEnv) {
      m_tcpGymEnv->CongestionStateSet(tcb, newState);
   }
+  if (m_fallback) {
+     m_fallback->CongestionStateSet(tcb, newState);
+  }
 }
 
 void
 TcpRlBase::CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event)
 {
   NS_LOG_FUNCTION (this);
+  TcpRlProfiler::Scope scope (TcpRlProfiler::CWND_EVENT);
 
-  if (!m_tcpGymEnv) {
-    CreateGymEnv();
+  if (m_tcpGymEnv) {
+     m_tcpGymEnv->CwndEvent(tcb, event);
   }
+  if (m_fallback) {
+     m_fallback->CwndEvent(tcb, event);
+  }
+}
+
+bool
+TcpRlBase::HasCongControl () const
+{
+  return m_actionMode == TcpGymEnv::ACTION_PACING || (m_fallback && m_fallback->HasCongControl ());
+}
 
+void
+TcpRlBase::CongControl (Ptr<TcpSocketState> tcb, const TcpRateOps::TcpRateConnection &rc,
+                        const TcpRateOps::TcpRateSample &rs)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_fallback && m_fallback->HasCongControl ()) {
+    // rate based delegates (TcpBbr) replace IncreaseWindow with CongControl,
+    // the env still applies the agent's window there, m_delivered is in bytes
+    TcpRlBase::IncreaseWindow (tcb, rs.m_delivered / tcb->m_segmentSize);
+    if (!AgentDrives ()) {
+      m_fallback->CongControl (tcb, rc, rs);
+    }
+    return;
+  }
+  // the window is still set in IncreaseWindow
   if (m_tcpGymEnv) {
-     m_tcpGymEnv->CwndEvent(tcb, event);
+     m_tcpGymEnv->ApplyPacing(tcb);
   }
 }
 
@@ -251,6 +574,23 @@ TcpRl::GetTypeId (void)
                    DoubleValue (-10.0),
                    MakeDoubleAccessor (&TcpRl::m_penalty),
                    MakeDoubleChecker<double> ())
+    .AddAttribute ("NotifyMode",
+                   "When an ACK notifies the agent, skipped ACKs are aggregated into the next observation.",
+                   EnumValue (TcpEventGymEnv::NOTIFY_EVERY_ACK),
+                   MakeEnumAccessor (&TcpRl::m_notifyMode),
+                   MakeEnumChecker (TcpEventGymEnv::NOTIFY_EVERY_ACK, "EveryAck",
+                                    TcpEventGymEnv::NOTIFY_EVERY_N_ACKS, "EveryNAcks",
+                                    TcpEventGymEnv::NOTIFY_PER_RTT, "PerRtt",
+                                    TcpEventGymEnv::NOTIFY_ON_CHANGE, "OnChange"))
+    .AddAttribute ("NotifyAckNum", "ACKs per notification in EveryNAcks mode.",
+                   UintegerValue (10),
+                   MakeUintegerAccessor (&TcpRl::m_notifyAckNum),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("NotifyThreshold",
+                   "Relative change of cWnd, bytesInFlight or RTT that notifies the agent in OnChange mode.",
+                   DoubleValue (0.1),
+                   MakeDoubleAccessor (&TcpRl::m_notifyThreshold),
+                   MakeDoubleChecker<double> (0.0))
   ;
   return tid;
 }
@@ -262,7 +602,12 @@ TcpRl::TcpRl (void)
 }
 
 TcpRl::TcpRl (const TcpRl& sock)
-  : TcpRlBase (sock)
+  : TcpRlBase (sock),
+    m_reward (sock.m_reward),
+    m_penalty (sock.m_penalty),
+    m_notifyMode (sock.m_notifyMode),
+    m_notifyAckNum (sock.m_notifyAckNum),
+    m_notifyThreshold (sock.m_notifyThreshold)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -277,6 +622,12 @@ TcpRl::GetName () const
   return "TcpRl";
 }
 
+Ptr<TcpCongestionOps>
+TcpRl::Fork ()
+{
+  return CopyObject<TcpRl> (this);
+}
+
 void
 TcpRl::CreateGymEnv()
 {
@@ -285,6 +636,9 @@ TcpRl::CreateGymEnv()
   env->SetSocketUuid(TcpRlBase::GenerateUuid());
   env->SetReward(m_reward);
   env->SetPenalty(m_penalty);
+  env->SetNotifyMode(m_notifyMode);
+  env->SetNotifyAckNum(m_notifyAckNum);
+  env->SetNotifyThreshold(m_notifyThreshold);
   m_tcpGymEnv = env;
 
   ConnectSocketCallbacks();
@@ -318,6 +672,28 @@ TcpRlTimeBased::GetTypeId (void)
                    DoubleValue (-1.0),
                    MakeDoubleAccessor (&TcpRlTimeBased::m_penalty),
                    MakeDoubleChecker<double> ())
+    .AddAttribute ("Batched",
+                   "Exchange all sockets with one observation/action matrix per step. Default: false",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&TcpRlTimeBased::m_batched),
+                   MakeBooleanChecker ())
+    .AddAttribute ("BatchSize",
+                   "Sockets of the batched exchange, the matrices have one row per socket and rows of "
+                   "sockets that did not start yet are zero. Default: 1",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&TcpRlTimeBased::m_batchSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Async",
+                   "Pipelined exchange: send the step t observation and keep applying the step t-1 action "
+                   "until the agent answers. Actions lag one step. Default: false",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&TcpRlTimeBased::m_async),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AgentPort",
+                   "Port of the agent, the pipelined exchange connects to it besides the OpenGymInterface. Default: 5555",
+                   UintegerValue (5555),
+                   MakeUintegerAccessor (&TcpRlTimeBased::m_agentPort),
+                   MakeUintegerChecker<uint16_t> ())
   ;
   return tid;
 }
@@ -329,7 +705,15 @@ TcpRlTimeBased::TcpRlTimeBased (void)
 }
 
 TcpRlTimeBased::TcpRlTimeBased (const TcpRlTimeBased& sock)
-  : TcpRlBase (sock)
+  : TcpRlBase (sock),
+    m_duration (sock.m_duration),
+    m_timeStep (sock.m_timeStep),
+    m_reward (sock.m_reward),
+    m_penalty (sock.m_penalty),
+    m_batched (sock.m_batched),
+    m_batchSize (sock.m_batchSize),
+    m_async (sock.m_async),
+    m_agentPort (sock.m_agentPort)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -344,6 +728,12 @@ TcpRlTimeBased::GetName () const
   return "TcpRlTimeBased";
 }
 
+Ptr<TcpCongestionOps>
+TcpRlTimeBased::Fork ()
+{
+  return CopyObject<TcpRlTimeBased> (this);
+}
+
 void
 TcpRlTimeBased::CreateGymEnv()
 {
@@ -354,9 +744,222 @@ TcpRlTimeBased::CreateGymEnv()
   env->SetTimeStep(m_timeStep);
   env->SetReward(m_reward);
   env->SetPenalty(m_penalty);
+  env->SetBatched(m_batched);
+  env->SetBatchSize(m_batchSize);
+  env->SetAsync(m_async);
+  env->SetAgentPort(m_agentPort);
   m_tcpGymEnv = env;
 
   ConnectSocketCallbacks();
 }
 
+uint32_t
+TcpRlTimeBased::GetAgentRowNum () const
+{
+  // batched sockets share one padded matrix per exchange
+  return m_batched ? m_batchSize : 1;
+}
+
+
+
+NS_OBJECT_ENSURE_REGISTERED (TcpRlPolicy);
+
+TypeId
+TcpRlPolicy::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlPolicy")
+    .SetParent<TcpRlTimeBased> ()
+    .SetGroupName ("Internet")
+    .AddConstructor<TcpRlPolicy> ()
+    .AddAttribute ("PolicyFile",
+                   "Policy exported by the agent. Default: policy.bin",
+                   StringValue ("policy.bin"),
+                   MakeStringAccessor (&TcpRlPolicy::m_policyFile),
+                   MakeStringChecker ())
+  ;
+  return tid;
+}
+
+TcpRlPolicy::TcpRlPolicy (void)
+  : TcpRlTimeBased ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlPolicy::TcpRlPolicy (const TcpRlPolicy& sock)
+  : TcpRlTimeBased (sock),
+    m_policyFile (sock.m_policyFile)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlPolicy::~TcpRlPolicy (void)
+{
+}
+
+std::string
+TcpRlPolicy::GetName () const
+{
+  return "TcpRlPolicy";
+}
+
+Ptr<TcpCongestionOps>
+TcpRlPolicy::Fork ()
+{
+  return CopyObject<TcpRlPolicy> (this);
+}
+
+void
+TcpRlPolicy::CreateGymEnv()
+{
+  NS_LOG_FUNCTION (this);
+  TcpRlTimeBased::CreateGymEnv();
+  m_tcpGymEnv->SetLocalAgent(TcpRlMlpPolicy::Get(m_policyFile));
+}
+
+
+
+NS_OBJECT_ENSURE_REGISTERED (TcpRlDataset);
+
+TypeId
+TcpRlDataset::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TcpRlDataset")
+    .SetParent<TcpRlTimeBased> ()
+    .SetGroupName ("Internet")
+    .AddConstructor<TcpRlDataset> ()
+    .AddAttribute ("Baseline",
+                   "Congestion control that owns the window. Default: TcpNewReno",
+                   TypeIdValue (TcpNewReno::GetTypeId ()),
+                   MakeTypeIdAccessor (&TcpRlDataset::m_baselineType),
+                   MakeTypeIdChecker ())
+    .AddAttribute ("DatasetFile",
+                   "Transitions of all sockets are appended to this file. Default: dataset.bin",
+                   StringValue ("dataset.bin"),
+                   MakeStringAccessor (&TcpRlDataset::m_datasetFile),
+                   MakeStringChecker ())
+  ;
+  return tid;
+}
+
+TcpRlDataset::TcpRlDataset (void)
+  : TcpRlTimeBased ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlDataset::TcpRlDataset (const TcpRlDataset& sock)
+  : TcpRlTimeBased (sock),
+    m_baselineType (sock.m_baselineType),
+    m_datasetFile (sock.m_datasetFile)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpRlDataset::~TcpRlDataset (void)
+{
+}
+
+std::string
+TcpRlDataset::GetName () const
+{
+  return "TcpRlDataset";
+}
+
+Ptr<TcpCongestionOps>
+TcpRlDataset::Fork ()
+{
+  return CopyObject<TcpRlDataset> (this);
+}
+
+void
+TcpRlDataset::CreateGymEnv()
+{
+  NS_LOG_FUNCTION (this);
+  TcpRlTimeBased::CreateGymEnv();
+  Ptr<TcpTimeStepGymEnv> env = DynamicCast<TcpTimeStepGymEnv> (m_tcpGymEnv);
+  env->SetObserveOnly(true);
+  // every socket is observed on its own step clock
+  env->SetBatched(false);
+}
+
+void
+TcpRlDataset::Init (Ptr<TcpSocketState> tcb)
+{
+  NS_LOG_FUNCTION (this << tcb);
+  TcpRlBase::Init (tcb);
+  // the writer replaces any agent configured for TcpRlBase
+  m_tcpGymEnv->SetLocalAgent(TcpRlDatasetWriter::Get(m_datasetFile));
+  // the baseline owns the window, there is no agent to fall back from
+  m_fallback = 0;
+
+  ObjectFactory factory;
+  factory.SetTypeId (m_baselineType);
+  m_baseline = factory.Create<TcpCongestionOps> ();
+  m_baseline->Init (tcb);
+}
+
+// the env sees every callback first, the baseline decides
+uint32_t
+TcpRlDataset::GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight)
+{
+  uint32_t ssThresh = TcpRlBase::GetSsThresh (tcb, bytesInFlight);
+  if (m_baseline) {
+    ssThresh = m_baseline->GetSsThresh (tcb, bytesInFlight);
+  }
+  return ssThresh;
+}
+
+void
+TcpRlDataset::IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked)
+{
+  TcpRlBase::IncreaseWindow (tcb, segmentsAcked);
+  if (m_baseline) {
+    m_baseline->IncreaseWindow (tcb, segmentsAcked);
+  }
+}
+
+void
+TcpRlDataset::PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time& rtt)
+{
+  TcpRlBase::PktsAcked (tcb, segmentsAcked, rtt);
+  if (m_baseline) {
+    m_baseline->PktsAcked (tcb, segmentsAcked, rtt);
+  }
+}
+
+void
+TcpRlDataset::CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState)
+{
+  TcpRlBase::CongestionStateSet (tcb, newState);
+  if (m_baseline) {
+    m_baseline->CongestionStateSet (tcb, newState);
+  }
+}
+
+void
+TcpRlDataset::CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event)
+{
+  TcpRlBase::CwndEvent (tcb, event);
+  if (m_baseline) {
+    m_baseline->CwndEvent (tcb, event);
+  }
+}
+
+// rate based baselines (TcpBbr) replace IncreaseWindow with CongControl
+bool
+TcpRlDataset::HasCongControl () const
+{
+  return m_baseline && m_baseline->HasCongControl ();
+}
+
+void
+TcpRlDataset::CongControl (Ptr<TcpSocketState> tcb, const TcpRateOps::TcpRateConnection &rc,
+                           const TcpRateOps::TcpRateSample &rs)
+{
+  // the env collects its window statistics in IncreaseWindow, m_delivered is in bytes
+  TcpRlBase::IncreaseWindow (tcb, rs.m_delivered / tcb->m_segmentSize);
+  m_baseline->CongControl (tcb, rc, rs);
+}
+
 } // namespace ns3
@@ -4,6 +4,8 @@
 #include "ns3/tcp-congestion-ops.h"
 #include "ns3/opengym-module.h"
 #include "ns3/tcp-socket-base.h"
+#include "ns3/socket-factory.h"
+#include "tcp-rl-env.h"
 
 namespace ns3 {
 
@@ -13,6 +15,7 @@ class TcpGymEnv;
 
 
 // used to get pointer to Congestion Algorithm
+// and to find the socket of a congestion control from its TcpSocketState
 class TcpSocketDerived : public TcpSocketBase
 {
 public:
@@ -20,9 +23,41 @@ public:
   virtual TypeId GetInstanceTypeId () const;
 
   TcpSocketDerived (void);
+  TcpSocketDerived (const TcpSocketDerived& sock);
   virtual ~TcpSocketDerived (void);
 
   Ptr<TcpCongestionOps> GetCongestionControlAlgorithm ();
+  uint32_t GetCongestionWindow () const;
+  Ptr<TcpSocketState> GetTcb () const;
+
+  // socket owning tcb, 0 if it is not a TcpSocketDerived
+  static Ptr<TcpSocketDerived> LookupSocket (Ptr<const TcpSocketState> tcb);
+  // socket bound to address:port, all sockets are scanned once per simulated instant on a miss
+  static Ptr<TcpSocketDerived> LookupSocket (Ipv4Address address, uint16_t port);
+
+protected:
+  // accepted sockets have to stay TcpSocketDerived
+  virtual Ptr<TcpSocketBase> Fork (void);
+};
+
+
+/*
+TcpL4Protocol::CreateSocket always creates a plain TcpSocketBase. This
+factory creates TcpSocketDerived sockets set up the same way (RTT
+estimator, congestion control and recovery from the TcpL4Protocol
+attributes), so the RL congestion controls and the flow metrics find
+them. Applications use "ns3::TcpSocketDerivedFactory" in place of
+"ns3::TcpSocketFactory".
+*/
+class TcpSocketDerivedFactory : public SocketFactory
+{
+public:
+  static TypeId GetTypeId (void);
+
+  // aggregates a factory to every node that has a TCP stack
+  static void InstallAll (void);
+
+  virtual Ptr<Socket> CreateSocket (void);
 };
 
 
@@ -51,16 +86,46 @@ public:
   virtual void PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time& rtt);
   virtual void CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState);
   virtual void CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event);
+  // ActionMode Pacing: the pacing rate is the agent's, not the socket's
+  virtual bool HasCongControl () const;
+  virtual void CongControl (Ptr<TcpSocketState> tcb, const TcpRateOps::TcpRateConnection &rc,
+                            const TcpRateOps::TcpRateSample &rs);
   virtual Ptr<TcpCongestionOps> Fork ();
+  // connection established, the env is created here
+  virtual void Init (Ptr<TcpSocketState> tcb);
+  // 0 until the env is created
+  uint32_t GetSocketUuid () const;
+  Ptr<TcpGymEnv> GetGymEnv () const;
 
 protected:
   static uint64_t GenerateUuid ();
   virtual void CreateGymEnv();
+  // observation rows per agent exchange, the batch size
+  virtual uint32_t GetAgentRowNum () const;
   void ConnectSocketCallbacks();
+  // the window is the delegate's until the agent's first valid, timely action
+  bool AgentDrives () const;
 
   // OpenGymEnv interface
   Ptr<TcpSocketBase> m_tcpSocket;
   Ptr<TcpGymEnv> m_tcpGymEnv;
+  std::string m_shmFile;
+  Ptr<TcpGymLocalAgent> m_localAgent;
+  std::string m_recordFile;
+  std::string m_replayFile;
+  TcpGymEnv::FeatureSet_t m_featureSet;
+  TcpGymEnv::ActionMode_t m_actionMode;
+  TypeId m_fallbackType;
+  Time m_actionDeadline;
+  uint32_t m_cwndCollapse;
+  bool m_zeroGoodputStop;
+  double m_rttLimit;
+  Time m_terminationPatience;
+  TypeId m_rewardType;
+  Time m_latencySlo;
+  // created per socket in Init, it sees every callback but only sets the
+  // window while the agent does not
+  Ptr<TcpCongestionOps> m_fallback;
 };
 
 
@@ -74,11 +139,15 @@ public:
   ~TcpRl ();
 
   virtual std::string GetName () const;
+  virtual Ptr<TcpCongestionOps> Fork ();
 private:
   virtual void CreateGymEnv();
   // OpenGymEnv env
   float m_reward {1.0};
   float m_penalty {-100.0};
+  TcpEventGymEnv::NotifyMode_t m_notifyMode;
+  uint32_t m_notifyAckNum;
+  double m_notifyThreshold;
 };
 
 
@@ -92,14 +161,76 @@ public:
   ~TcpRlTimeBased ();
 
   virtual std::string GetName () const;
+  virtual Ptr<TcpCongestionOps> Fork ();
 
-private:
+protected:
   virtual void CreateGymEnv();
+  virtual uint32_t GetAgentRowNum () const;
 
+private:
   Time m_duration;
   Time m_timeStep;
   float m_reward;
   float m_penalty;
+  bool m_batched;
+  uint32_t m_batchSize;
+  bool m_async;
+  uint32_t m_agentPort;
+};
+
+
+// TcpRlTimeBased driven by an exported policy evaluated in-process, no agent
+class TcpRlPolicy : public TcpRlTimeBased
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlPolicy ();
+  TcpRlPolicy (const TcpRlPolicy& sock);
+  ~TcpRlPolicy ();
+
+  virtual std::string GetName () const;
+  virtual Ptr<TcpCongestionOps> Fork ();
+
+private:
+  virtual void CreateGymEnv();
+
+  std::string m_policyFile;
+};
+
+
+/*
+Offline dataset generation: a classic controller (Baseline, e.g. TcpCubic)
+owns the window while a TcpTimeStepGymEnv only observes it. Every step is
+written as a transition by TcpRlDatasetWriter, there is no agent.
+*/
+class TcpRlDataset : public TcpRlTimeBased
+{
+public:
+  static TypeId GetTypeId (void);
+
+  TcpRlDataset ();
+  TcpRlDataset (const TcpRlDataset& sock);
+  ~TcpRlDataset ();
+
+  virtual std::string GetName () const;
+  virtual Ptr<TcpCongestionOps> Fork ();
+  virtual uint32_t GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight);
+  virtual void IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked);
+  virtual void PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time& rtt);
+  virtual void CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState);
+  virtual void CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event);
+  virtual bool HasCongControl () const;
+  virtual void CongControl (Ptr<TcpSocketState> tcb, const TcpRateOps::TcpRateConnection &rc,
+                            const TcpRateOps::TcpRateSample &rs);
+  virtual void Init (Ptr<TcpSocketState> tcb);
+
+private:
+  virtual void CreateGymEnv();
+
+  TypeId m_baselineType;
+  std::string m_datasetFile;
+  Ptr<TcpCongestionOps> m_baseline;
 };
 
 } // namespace ns3
@@ -1,3 +1,9 @@
+import os
+import time
+
+import numpy as np
+
+
 class Tcp(object):
     """docstring for Tcp"""
     def __init__(self):
@@ -35,43 +41,46 @@ class TcpEventBased(Tcp):
         segmentsAcked = obs[7]
         # estimated bytes in flight
         bytesInFlight  = obs[8]
-        # last estimation of RTT
-        lastRtt_us  = obs[9]
-        # min value of RTT
-        minRtt_us  = obs[10]
-        # function from Congestion Algorithm (CA) interface:
-        #  GET_SS_THRESH = 0 (packet loss),
-        #  INCREASE_WINDOW (packet acked),
-        #  PKTS_ACKED (unused),
-        #  CONGESTION_STATE_SET (unused),
-        #  CWND_EVENT (unused),
-        calledFunc = obs[11]
-        # Congetsion Algorithm (CA) state:
-        #  CA_OPEN = 0,
-        #  CA_DISORDER,
-        #  CA_CWR,
-        #  CA_RECOVERY,
-        #  CA_LOSS,
-        #  CA_LAST_STATE
-        caState = obs[12]
-        # Congetsion Algorithm (CA) event:
-        #  CA_EVENT_TX_START = 0,
-        #  CA_EVENT_CWND_RESTART,
-        #  CA_EVENT_COMPLETE_CWR,
-        #  CA_EVENT_LOSS,
-        #  CA_EVENT_ECN_NO_CE,
-        #  CA_EVENT_ECN_IS_CE,
-        #  CA_EVENT_DELAYED_ACK,
-        #  CA_EVENT_NON_DELAYED_ACK,
-        caEvent = obs[13]
-        # ECN state:
-        #  ECN_DISABLED = 0,
-        #  ECN_IDLE,
-        #  ECN_CE_RCVD,
-        #  ECN_SENDING_ECE,
-        #  ECN_ECE_RCVD,
-        #  ECN_CWR_SENT
-        ecnState = obs[14]
+        # the rest depends on the feature set, Minimal ends here
+        if len(obs) > 9:
+            # last estimation of RTT
+            lastRtt_us  = obs[9]
+        if len(obs) > 14:
+            # min value of RTT
+            minRtt_us  = obs[10]
+            # function from Congestion Algorithm (CA) interface:
+            #  GET_SS_THRESH = 0 (packet loss),
+            #  INCREASE_WINDOW (packet acked),
+            #  PKTS_ACKED (unused),
+            #  CONGESTION_STATE_SET (unused),
+            #  CWND_EVENT (unused),
+            calledFunc = obs[11]
+            # Congetsion Algorithm (CA) state:
+            #  CA_OPEN = 0,
+            #  CA_DISORDER,
+            #  CA_CWR,
+            #  CA_RECOVERY,
+            #  CA_LOSS,
+            #  CA_LAST_STATE
+            caState = obs[12]
+            # Congetsion Algorithm (CA) event:
+            #  CA_EVENT_TX_START = 0,
+            #  CA_EVENT_CWND_RESTART,
+            #  CA_EVENT_COMPLETE_CWR,
+            #  CA_EVENT_LOSS,
+            #  CA_EVENT_ECN_NO_CE,
+            #  CA_EVENT_ECN_IS_CE,
+            #  CA_EVENT_DELAYED_ACK,
+            #  CA_EVENT_NON_DELAYED_ACK,
+            caEvent = obs[13]
+            # ECN state:
+            #  ECN_DISABLED = 0,
+            #  ECN_IDLE,
+            #  ECN_CE_RCVD,
+            #  ECN_SENDING_ECE,
+            #  ECN_ECE_RCVD,
+            #  ECN_CWR_SENT
+            ecnState = obs[14]
 
         # compute new values
         new_cWnd = 10 * segmentSize
@@ -111,16 +120,29 @@ class TcpTimeBased(Tcp):
         segmentsAckedSum = obs[9]
         # segmentsAckedAvg
         segmentsAckedAvg = obs[10]
-        # avgRtt
-        avgRtt = obs[11]
-        # minRtt
-        minRtt = obs[12]
-        # avgInterTx
-        avgInterTx = obs[13]
-        # avgInterRx
-        avgInterRx = obs[14]
-        # throughput
-        throughput = obs[15]
+        # the rest depends on the feature set, Minimal ends here
+        if len(obs) > 15:
+            # avgRtt
+            avgRtt = obs[11]
+            # minRtt
+            minRtt = obs[12]
+            # avgInterTx
+            avgInterTx = obs[13]
+            # avgInterRx
+            avgInterRx = obs[14]
+            # throughput
+            throughput = obs[15]
+        if len(obs) > 21:
+            # action latency in steps: 0 synchronous / 1 pipelined (Async)
+            actionLatency = obs[16]
+            # RTT percentiles in us, from a log-bucket histogram (~6% error)
+            p50Rtt = obs[17]
+            p95Rtt = obs[18]
+            p99Rtt = obs[19]
+            # RTT variance in us^2
+            rttVariance = obs[20]
+            # maxRtt in us
+            maxRtt = obs[21]
 
         # compute new values
         new_cWnd = 10 * segmentSize
@@ -130,3 +152,163 @@ class TcpTimeBased(Tcp):
         actions = [new_ssThresh, new_cWnd]
 
         return actions
+
+
+class TcpTimeBasedBatch(object):
+    """Dispatch the observation matrix of a batched time-based env
+    (one row per socket, UUID in the first column) to one agent per
+    socket and collect their actions into one action matrix"""
+    def __init__(self, agent_class=TcpTimeBased):
+        super(TcpTimeBasedBatch, self).__init__()
+        self.agent_class = agent_class
+        self.agents = {}
+
+    def set_spaces(self, obs, act):
+        self.obsSpace = obs
+        self.actSpace = act
+
+    def get_action(self, obs, reward, done, info):
+        # per socket rewards come as "uuid:reward;uuid:reward..."
+        rewards = {}
+        if info:
+            for item in info.split(';'):
+                uuid, value = item.split(':')
+                rewards[int(uuid)] = float(value)
+
+        width = self.obsSpace.shape[-1]
+        actWidth = self.actSpace.shape[-1]
+        rows = np.reshape(np.asarray(obs), (-1, width))
+        actions = []
+        for row in rows:
+            socketUuid = int(row[0])
+            if socketUuid == 0:
+                # socket did not start yet, ns-3 ignores its action row
+                actions.extend([0] * actWidth)
+                continue
+            agent = self.agents.get(socketUuid, None)
+            if agent is None:
+                agent = self.agent_class()
+                agent.set_spaces(self.obsSpace, self.actSpace)
+                self.agents[socketUuid] = agent
+            actions.extend(agent.get_action(row, rewards.get(socketUuid, 0.0), done, info))
+
+        return actions
+
+
+class ShmEnv(object):
+    """Agent side of the shared memory transport (ns-3 side: --shm_file,
+    layout in tcp-rl-shm.h). Offers the reset/step subset of
+    ns3env.Ns3Env used by TCP-RL-Agent.py without ZMQ and protobuf.
+    Actions are uint32 rows, ns-3 only allows the Absolute and Pacing
+    action modes over it. Batched runs exchange (rows, width) matrices,
+    the shapes come from the header.
+    Records are published by storing their seq last, which relies on
+    the in-order stores of x86"""
+    HEADER_SIZE = 64
+    # busy polls before yielding between polls, none on a single core
+    SPIN_NUM = 1000 if (os.cpu_count() or 1) > 1 else 0
+
+    def __init__(self, path, timeout=60.0):
+        super(ShmEnv, self).__init__()
+        from gym import spaces
+
+        self.path = path
+        self.timeout = timeout
+        self._open()
+
+        self.observation_space = spaces.Box(low=0, high=1000000000, shape=self.obsShape, dtype=np.uint64)
+        # windows up to 4 GiB, like the ns-3 action space
+        self.action_space = spaces.Box(low=0, high=4294967295, shape=self.actionShape, dtype=np.uint32)
+
+    def _open(self):
+        start = time.time()
+        self.mm = None
+        while self.mm is None:
+            try:
+                if os.path.getsize(self.path) >= self.HEADER_SIZE:
+                    mm = np.memmap(self.path, dtype=np.uint8, mode='r+')
+                    # a closed file is the previous episode's, not unlinked yet
+                    if bytes(mm[:4]) == b'TRLS' and not mm[:self.HEADER_SIZE].view('<u4')[5]:
+                        self.mm = mm
+                        continue
+            except (OSError, ValueError):
+                pass
+            if time.time() - start > self.timeout:
+                raise RuntimeError("No shared memory transport at " + self.path)
+            time.sleep(0.01)
+
+        header32 = self.mm[:self.HEADER_SIZE].view('<u4')
+        header64 = self.mm[:self.HEADER_SIZE].view('<u8')
+        obsCapacity, actionCapacity, slotNum = header32[2], header32[3], header32[4]
+        rowNum, obsWidth, actionWidth = int(header32[12]), int(header32[13]), int(header32[14])
+        # one dimensional unless the sockets are batched
+        self.obsShape = (rowNum, obsWidth) if rowNum > 1 else (obsWidth,)
+        self.actionShape = (rowNum, actionWidth) if rowNum > 1 else (actionWidth,)
+        self.closed = header32[5:6]
+        # the simulator aborts once this process is gone or detached
+        header32[10] = os.getpid()
+        self.agentClosed = header32[11:12]
+        self.obsSeq = header64[3:4]
+        self.actionSeq = header64[4:5]
+        self.slotNum = int(slotNum)
+
+        obsType = np.dtype([('seq', '<u8'), ('num', '<u4'), ('reward', '<f4'), ('done', '<u4'),
+                            ('padding', '<u4'), ('values', '<u8', (obsCapacity,))])
+        actionType = np.dtype([('seq', '<u8'), ('num', '<u4'), ('padding', '<u4'),
+                               ('values', '<u4', (actionCapacity,))])
+        obsEnd = self.HEADER_SIZE + self.slotNum * obsType.itemsize
+        self.obsRing = self.mm[self.HEADER_SIZE:obsEnd].view(obsType)
+        self.actionRing = self.mm[obsEnd:obsEnd + self.slotNum * actionType.itemsize].view(actionType)
+        # per slot views, building them costs more than the exchange
+        self.obsValues = [self.obsRing['values'][i] for i in range(self.slotNum)]
+        self.obsNums = [self.obsRing['num'][i:i + 1] for i in range(self.slotNum)]
+        self.obsRewards = [self.obsRing['reward'][i:i + 1] for i in range(self.slotNum)]
+        self.obsDones = [self.obsRing['done'][i:i + 1] for i in range(self.slotNum)]
+        self.actionValues = [self.actionRing['values'][i] for i in range(self.slotNum)]
+        self.actionNums = [self.actionRing['num'][i:i + 1] for i in range(self.slotNum)]
+        self.actionSeqs = [self.actionRing['seq'][i:i + 1] for i in range(self.slotNum)]
+        self.seq = 0
+        self.obs = None
+
+    def _wait(self, seq):
+        spins = 0
+        while self.obsSeq[0] < seq:
+            if self.closed[0]:
+                return False
+            spins += 1
+            if spins > self.SPIN_NUM:
+                os.sched_yield()
+        return True
+
+    def _recv(self):
+        if not self._wait(self.seq + 1):
+            return self.obs, 0.0, True, ""
+        self.seq += 1
+        slot = (self.seq - 1) % self.slotNum
+        self.obs = self.obsValues[slot][:self.obsNums[slot][0]].copy().reshape(self.obsShape)
+        return self.obs, float(self.obsRewards[slot][0]), bool(self.obsDones[slot][0]), ""
+
+    def _send(self, action):
+        slot = (self.seq - 1) % self.slotNum
+        action = np.ravel(action)
+        num = len(action)
+        self.actionValues[slot][:num] = action
+        self.actionNums[slot][0] = num
+        self.actionSeqs[slot][0] = self.seq
+        self.actionSeq[0] = self.seq
+
+    def reset(self):
+        # sim.cc --episodes recreates the file for every episode
+        if self.closed[0]:
+            self._open()
+        obs, _, _, _ = self._recv()
+        return obs
+
+    def step(self, action):
+        self._send(action)
+        return self._recv()
+
+    def close(self):
+        if self.mm is not None:
+            self.agentClosed[0] = 1
+        self.mm = None